@@ -0,0 +1,115 @@
+//
+// Coverage Evaluation Shader Program (3/3)
+// ----------------------------------------
+//  A replacement of `eval.frag` that accumulates cost during rasterization.
+//  Simulated pixels are binary, so
+//
+//    sum(|real - sim|) = sum(real) + sum(1 - 2 * real) over covered pixels.
+//
+//  `sum(real)` is computed on host once per real universe; this shader
+//  accumulates the rest, and `reduce.comp` adds them up. Each covered pixel is
+//  counted only once even if cells overlap, which is ensured by a first-writer
+//  bitmask.
+//L
+#version 450
+precision mediump float;
+
+
+
+//
+// Constants
+// ---------
+//  Scale of fixed-point costs. Must be consistent with `reduce.comp`.
+const float COST_SCALE = 256.0;
+//  Format of the real universe. See `cost.comp`.
+const uint FORMAT_BIT = 2;
+//L
+
+
+
+//
+// Inputs
+// ------
+//  Real universes, in 32-bit floats or bit-packed if `FORMAT` is `FORMAT_BIT`.
+layout(std430, binding=0) readonly
+buffer real_univ_buf {
+  uint[] real_univ;
+};
+//  Offset of the real universe of each simulated universe in `real_univ`, in
+//  words.
+layout(std430, binding=14) readonly
+buffer univ_frames_buf {
+  uint[] univ_frames;
+};
+//  Built-in layer index, i.e. the universe index in the current framebuffer.
+// in int gl_Layer;
+//L
+
+
+
+//
+// Outputs
+// -------
+//  Simulated universes. Drawn as `eval.frag` does.
+layout(location=0)
+out float sim_univ;
+//  Bitmask of covered pixels. Should have length of `NUNIV * NWORD_UNIV`, and
+//  be cleared before drawing.
+layout(std430, binding=7)
+buffer cover_mask_buf {
+  uint[] cover_mask;
+};
+//  Fixed-point cost of covered pixels for each universe, scaled by
+//  `COST_SCALE`. Should be cleared before drawing.
+layout(std430, binding=8)
+buffer cover_costs_buf {
+  int[] cover_costs;
+};
+//L
+
+
+
+//
+// Push Constants
+// --------------
+layout(std430, push_constant) uniform EvalMeta {
+  // The index of the first universe in the current framebuffer. Used in
+  // `eval.geom`.
+  uint BASE_UNIV;
+  // The ratio of width to height. Used in `eval.geom`.
+  float RATIO;
+  // Index of the first universe of the current framebuffer in `cover_costs`.
+  uint COST_OFFSET;
+  // Width of universes.
+  uint WIDTH;
+  // Number of words in each universe in `cover_mask`.
+  uint NWORD_UNIV;
+  // Format of the real universe.
+  uint FORMAT;
+};
+//L
+
+
+
+float real_pixel(uint univ, uint idx) {
+  uint offset = univ_frames[univ];
+  if (FORMAT == FORMAT_BIT) {
+    return float((real_univ[offset + (idx >> 5)] >> (idx & 31)) & 1);
+  } else {
+    return uintBitsToFloat(real_univ[offset + idx]);
+  }
+}
+
+void main() {
+  sim_univ = 1.;
+
+  uint univ = COST_OFFSET + uint(gl_Layer);
+  uvec2 coord = uvec2(gl_FragCoord.xy);
+  uint idx = coord.y * WIDTH + coord.x;
+  uint bit = 1u << (idx & 31);
+  uint prev = atomicOr(cover_mask[univ * NWORD_UNIV + (idx >> 5)], bit);
+  if ((prev & bit) == 0) {
+    float delta = 1.0 - 2.0 * real_pixel(univ, idx);
+    atomicAdd(cover_costs[univ], int(round(delta * COST_SCALE)));
+  }
+}
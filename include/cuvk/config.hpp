@@ -15,6 +15,20 @@ L_STATIC struct VulkanRequirements {
 const uint32_t MAX_DEV_QUEUE_COUNT = 8;
 const uint32_t MAX_GRAPH_PIPE_STAGE_COUNT = 5;
 const float DEFAULT_QUEUE_PRIORITY = 0.5;
+// Size of memory blocks chained to heap arenas after `HeapManager::make`.
+const VkDeviceSize ARENA_BLOCK_SIZE = 16 << 20;
+// Size of the smallest size class of heap arenas. Size classes are powers of 2
+// up to a quarter of `ARENA_BLOCK_SIZE`; larger requests get dedicated blocks.
+const VkDeviceSize ARENA_MIN_CLASS_SIZE = 256;
+const uint32_t ARENA_NCLASS = 15;
+// Host transfers of at least this size bypass caches with non-temporal
+// instructions on x86. Smaller ones are likely to be read again from cache.
+const size_t TRANSFER_STREAM_THRESHOLD = 256 << 10;
+// Host transfers of at least this size are split across transfer threads.
+const size_t TRANSFER_PARALLEL_THRESHOLD = 4 << 20;
+// Number of threads a host transfer is split across, including the calling
+// thread. A few cores are usually enough to saturate memory bandwidth.
+const uint32_t MAX_TRANSFER_THREAD_COUNT = 4;
 
 
 L_CUVK_END_
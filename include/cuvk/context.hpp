@@ -15,6 +15,8 @@ struct Vulkan {
   VkInstance inst;
   std::vector<PhysicalDeviceInfo> phys_dev_infos;
   VkDebugUtilsMessengerEXT debug_msgr;
+  // Whether `VK_KHR_get_physical_device_properties2` is enabled.
+  bool has_props2;
 
   Vulkan() noexcept;
   bool make() noexcept;
@@ -23,6 +25,7 @@ struct Vulkan {
   ~Vulkan() noexcept;
 
 private:
+  bool make_inst(bool debug) noexcept;
   bool enum_phys_dev() noexcept;
 };
 
@@ -32,6 +35,15 @@ struct PhysicalDeviceInfo {
   VkPhysicalDevice phys_dev;
   VkPhysicalDeviceProperties phys_dev_props;
   std::vector<VkQueueFamilyProperties> queue_fam_props;
+  // Whether host allocations can be imported as device memory by
+  // `VK_EXT_external_memory_host`, and the alignment of the imported pointers
+  // and sizes.
+  bool has_ext_mem_host;
+  VkDeviceSize min_imported_host_ptr_align;
+  // Whether heap budgets can be queried by `VK_EXT_memory_budget`, and the
+  // function to query them with. `nullptr` if not supported.
+  bool has_mem_budget;
+  PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_mem_props2;
 };
 
 
@@ -54,6 +66,8 @@ struct Context {
   VkDevice dev;
   size_t nqueue;
   std::array<Queue, MAX_DEV_QUEUE_COUNT> queues;
+  // `nullptr` if `VK_EXT_external_memory_host` is not enabled.
+  PFN_vkGetMemoryHostPointerPropertiesEXT get_mem_host_ptr_props;
 
   Context(const PhysicalDeviceInfo& phys_dev_info, 
     const VkPhysicalDeviceFeatures& phys_dev_feats,
@@ -54,6 +54,10 @@
 typedef uint32_t CuvkBool;
 typedef uint32_t CuvkSize;
 //
+// Sizes of memory are given in 64-bit integers.
+//
+typedef uint64_t CuvkDeviceSize;
+//
 // ## 3 Error Handling
 //
 // CUVK functions report error through return values. A failed call will return
@@ -134,19 +138,118 @@ L_EXPORT void L_STDCALL cuvkEnumeratePhysicalDevices(
 // Memory allocation is done internally by CUVK during context creation. The
 // user-application *must* provide this requirement so that CUVK can calculate
 // how much memory should be allocated.
+//
+// Simulated universes are output in one of the following formats. Cells are
+// drawn as 1 and background is 0 in all formats.
+//
+// - `FLOAT32`: Each pixel is a 32-bit float.
+// - `UNORM8`: Each pixel is a byte, 0 or 255.
+// - `BIT`: Pixels are packed into 32-bit words in row-major order, from the
+//   least significant bit. The last word of each universe is padded with 0.
+//   The real universe is binarized with threshold 0.5 in this format.
+//
+enum CuvkSimUnivFormat {
+  CUVK_SIM_UNIV_FORMAT_FLOAT32 = 0,
+  CUVK_SIM_UNIV_FORMAT_UNORM8  = 1,
+  CUVK_SIM_UNIV_FORMAT_BIT     = 2,
+};
+//
+// Costs are distances between simulated universes and the real universe, by
+// one of the following metrics.
+//
+// - `L1`: Sum of `|real - sim|` over pixels.
+// - `L2`: Sum of `(real - sim)^2` over pixels.
+// - `TRUNCATED_L1`: Sum of `min(|real - sim|, truncation)` over pixels.
+// - `IOU`: `1 - |real & sim| / |real | sim|`, where universes are masks
+//   thresholded at 0.5. It's 0 when both masks are empty.
+// - `DICE`: `1 - 2 * |real & sim| / (|real| + |sim|)`, where universes are
+//   masks thresholded at 0.5. It's 0 when both masks are empty.
+//
+// `IOU` and `DICE` are not sums over pixels, so they can't be used in
+// incremental evaluations, evaluations with ROIs, coarse-to-fine evaluations,
+// or base evaluations.
+//
+enum CuvkCostMetric {
+  CUVK_COST_METRIC_L1           = 0,
+  CUVK_COST_METRIC_L2           = 1,
+  CUVK_COST_METRIC_TRUNCATED_L1 = 2,
+  CUVK_COST_METRIC_IOU          = 3,
+  CUVK_COST_METRIC_DICE         = 4,
+};
+//
+// Costs are computed in one of the following modes.
+//
+// - `FULL_FRAME`: Costs are computed over entire universes after drawing.
+// - `COVERAGE`: Costs are accumulated while cells are drawn, so the work scales
+//   with the area of cells rather than the area of universes. Costs are
+//   accumulated in fixed point of 1/256, so a universe should have no more than
+//   2^23 pixels. Incremental evaluations are not affected. Only `L1` metric is
+//   supported in this mode.
+//
+enum CuvkCostMode {
+  CUVK_COST_MODE_FULL_FRAME = 0,
+  CUVK_COST_MODE_COVERAGE   = 1,
+};
+//
+// Bacteria and real universes given in evaluations are written by the host and
+// read by the device many times, which is slow if the device reads them over a
+// bus from host memory. They can be placed in one of the following ways.
+//
+// - `AUTO`: Inputs are staged if host-visible memory is not a part of the
+//   device's own memory, e.g. on most discrete GPUs.
+// - `DIRECT`: Inputs are read by the device from host-visible memory.
+// - `STAGED`: Inputs are copied to device-local memory before use. This costs
+//   device memory and a copy in each evaluation.
+//
+enum CuvkInputPlacement {
+  CUVK_INPUT_PLACEMENT_AUTO   = 0,
+  CUVK_INPUT_PLACEMENT_DIRECT = 1,
+  CUVK_INPUT_PLACEMENT_STAGED = 2,
+};
+//
+// `nspec`, `nbac` and `nuniv` are batch sizes; they bound the device memory
+// used rather than the size of invocations. Larger invocations are split into
+// batches internally, see 8.1.4. Batch sizes are lowered to device limits, and
+// the actual values are written back. Buffers of evaluation bacteria are
+// allocated for `nspec * nbac` bacteria at first, and grow with invocations up
+// to device limits; buffers of rendered universes and costs grow up to `nuniv`
+// universes.
+//
 struct CuvkMemoryRequirements {
-  // Number of deformation specifications.
+  // Number of deformation specifications per batch.
   CuvkSize nspec;
   // Number of bacteria input per batch. The bacteria output in deformation
-  // tasks and input in evaluation tasks will have size `nspecs * nbac`.
+  // tasks will have size `nspecs * nbac`, which is also the initial capacity
+  // of bacteria input in evaluation tasks.
   CuvkSize nbac;
-  // Number of universes to be renderd in one batch. This number will also be
-  // the length of cost output.
+  // Number of universes to be renderd in one batch.
   CuvkSize nuniv;
   // Width of the simulated and the real universes.
   CuvkSize width;
   // Height of the simulated and the real universes.
   CuvkSize height;
+  // Format of simulated universes. Narrower formats reduce memory consumption
+  // and readback bandwidth so that more universes can be evaluated in a batch.
+  CuvkSimUnivFormat simUnivFormat;
+  // Mode of cost computation in evaluation.
+  CuvkCostMode costMode;
+  // Number of real universes that can be resident on device at the same time.
+  // See 7.3.
+  CuvkSize nRealUniv;
+  // Level of the real universe pyramid used in coarse-to-fine evaluation.
+  // Coarse universes are downsampled by `2^coarseLevel` in both dimensions. 0
+  // disables coarse-to-fine evaluation. See 8.1.2.2.
+  CuvkSize coarseLevel;
+  // Metric of costs. It's compiled into the shaders, so it can't be changed
+  // without creating a new context.
+  CuvkCostMetric costMetric;
+  // Upper bound of the cost of a pixel in `TRUNCATED_L1` metric. Ignored by
+  // other metrics.
+  float truncation;
+  // Weight the cost of each pixel by a resident weight map. See 7.4.
+  CuvkBool useWeightMap;
+  // Placement of evaluation inputs.
+  CuvkInputPlacement inputPlacement;
 };
 L_EXPORT CuvkResult L_STDCALL cuvkCreateContext(
   CuvkSize physicalDeviceIndex,
@@ -156,9 +259,192 @@ L_EXPORT CuvkResult L_STDCALL cuvkCreateContext(
 //
 // Fails when:
 // - The device is unable to fulfill the memory requirements.
+// - The device can't bind as many storage buffers and samplers as evaluation
+//   uses at once.
+//
+// Memory a context would take can be estimated without creating it. Memory
+// requirements are validated and lowered to device limits as they are in
+// context creation.
+//
+struct CuvkMemoryBreakdown {
+  // Size of the host-visible buffers of task inputs and outputs.
+  CuvkDeviceSize hostVisibleSize;
+  // Size of the device-only buffers of intermediate data and resident
+  // universes.
+  CuvkDeviceSize deviceOnlySize;
+  // Size of the images universes are drawn to.
+  CuvkDeviceSize imageSize;
+};
+L_EXPORT CuvkResult L_STDCALL cuvkEstimateMemory(
+  CuvkSize physicalDeviceIndex,
+  L_INOUT CuvkMemoryRequirements* memoryRequirements,
+  L_OUT CuvkMemoryBreakdown* pEstimate
+);
+//
+// Images are estimated by their texels; devices may take more for tiling and
+// alignment. Evaluation buffers are estimated at `nspec * nbac` bacteria and
+// `nuniv` universes; they take more if they grow for more bacteria.
+//
+// Fails when:
+// - The device is unable to fulfill the memory requirements.
+//
 //
+// ### 7.3 Real Universe Registration
 //
-// ### 7.3 Context Destruction
+// The real universe usually stays the same across thousands of evaluations. It
+// can be registered once and kept resident on device, so that it's not sent
+// again on each evaluation. A handle to the resident real universe is returned,
+// to be referred to in invocations. If the context is created with a non-zero
+// `coarseLevel`, the downsampled real universes of coarse-to-fine evaluation
+// are built once here as well.
+//
+typedef struct CuvkRealUniverseInfo {} *CuvkRealUniverse;
+L_EXPORT CuvkResult L_STDCALL cuvkCreateRealUniverse(
+  CuvkContext context,
+  const void* pRealUniv,
+  L_OUT CuvkRealUniverse* pRealUniverse
+);
+//
+// `pRealUniv` is in 32-bit floats, of the size used to create the context.
+//
+// Fails when:
+// - All of the `nRealUniv` slots are in use.
+// - Unexpected failure occurs.
+//
+L_EXPORT void L_STDCALL cuvkDestroyRealUniverse(
+  CuvkContext context,
+  CuvkRealUniverse realUniverse
+);
+//
+// **NOTE** The user application *must* ensure no unfinished task refers to the
+// real universe before destroying it.
+//
+// ### 7.4 Weight Map
+//
+// If the context is created with `useWeightMap`, the cost of each pixel is
+// multiplied by its weight in the weight map, e.g. `sum(w * |real - sim|)` in
+// `L1` metric, so that borders, debris and uncertain regions can be
+// down-weighted. In `IOU` and `DICE` metrics, areas are weighted. The weight
+// map is kept resident on device and shared by all real universes.
+//
+L_EXPORT CuvkResult L_STDCALL cuvkSetWeightMap(
+  CuvkContext context,
+  const void* pWeightMap
+);
+//
+// `pWeightMap` is in 32-bit floats, of the size used to create the context.
+// It *must* be set before any evaluation. Setting the weight map invalidates
+// the base universe of incremental evaluations.
+//
+// Fails when:
+// - The context is not created with `useWeightMap`.
+// - Unexpected failure occurs.
+//
+// Weight maps can't be used in `COVERAGE` cost mode, coarse-to-fine
+// evaluations, or evaluations with ROIs.
+//
+// **NOTE** The user application *must* ensure no unfinished task refers to the
+// weight map before setting it again.
+//
+// ### 7.5 Host Memory
+//
+// If the device supports `VK_EXT_external_memory_host`, host memory given in
+// deformation invocations, and `pRealUniv`, `pSimUnivs` and `pCosts` of
+// evaluation invocations, is imported and accessed by the device in place,
+// rather than copied through staging buffers. Outputs of top-K and
+// coarse-to-fine evaluation are post-processed by host and thus always copied.
+// Memory to be imported has to be aligned to the device's requirement; memory
+// allocated with this function is guaranteed to be.
+//
+L_EXPORT CuvkResult L_STDCALL cuvkAllocHostMemory(
+  CuvkContext context,
+  CuvkSize size,
+  L_OUT void** ppMemory
+);
+//
+// Memory allocated here can still be used if the extension is not supported;
+// it is then copied as other memory is.
+//
+// Fails when:
+// - The host is out of memory.
+//
+L_EXPORT void L_STDCALL cuvkFreeHostMemory(
+  CuvkContext context,
+  void* pMemory
+);
+//
+// **NOTE** The user application *must* ensure no unfinished task refers to the
+// memory before freeing it.
+//
+// Host buffers are host-visible device memory owned by the context, mapped for
+// the user application to write inputs to and read outputs from. Deformation
+// inputs and outputs in host buffers are accessed by the device in place, on
+// any device. So are `pRealUniv`, `pSimUnivs` and `pCosts` of evaluation,
+// except for the outputs of top-K and coarse-to-fine evaluation, which are
+// post-processed by host. Host buffers may be uncached on the host side, so
+// they are best written sequentially and read once.
+//
+// `pBacs` of evaluation is always copied, even if it's in a host buffer;
+// bacteria are uploaded to an input slot ahead of the chunk reading them.
+//
+L_EXPORT CuvkResult L_STDCALL cuvkAllocHostBuffer(
+  CuvkContext context,
+  CuvkSize size,
+  L_OUT void** ppBuffer
+);
+//
+// A range in a host buffer is only accessed in place if its offset from the
+// start of the buffer is a multiple of `minStorageBufferOffsetAlignment` of the
+// device; it is copied otherwise. Offsets of multiples of 256 are safe on all
+// devices.
+//
+// Fails when:
+// - The device is out of host-visible memory.
+//
+L_EXPORT void L_STDCALL cuvkFreeHostBuffer(
+  CuvkContext context,
+  void* pBuffer
+);
+//
+// **NOTE** The user application *must* ensure no unfinished task refers to the
+// buffer before freeing it. Host buffers are freed with the context.
+//
+// ### 7.6 Memory Statistics
+//
+// Memory usage of a context can be queried at any time, for instance to decide
+// how many contexts fit on a device.
+//
+#define CUVK_MAX_MEMORY_HEAP_COUNT 16
+struct CuvkMemoryHeapStats {
+  // Size of the heap.
+  CuvkDeviceSize size;
+  // Whether the heap is a part of the device's own memory.
+  CuvkBool deviceLocal;
+  // Memory allocated from the heap by the context.
+  CuvkDeviceSize contextUsage;
+  // Memory allocated from the heap by the process.
+  CuvkDeviceSize processUsage;
+  // Memory the process can allocate from the heap without degrading
+  // performance, including `processUsage`.
+  CuvkDeviceSize budget;
+};
+struct CuvkMemoryStats {
+  // Number of memory heaps of the device.
+  CuvkSize nHeap;
+  CuvkMemoryHeapStats heaps[CUVK_MAX_MEMORY_HEAP_COUNT];
+  // Memory taken by each of the resources of the context.
+  CuvkMemoryBreakdown breakdown;
+};
+L_EXPORT void L_STDCALL cuvkQueryMemoryStats(
+  CuvkContext context,
+  L_OUT CuvkMemoryStats* pStats
+);
+//
+// `processUsage` and `budget` are reported by the driver if the device
+// supports `VK_EXT_memory_budget`. Otherwise, `processUsage` is
+// `contextUsage` and `budget` is the heap size.
+//
+// ### 7.7 Context Destruction
 //
 // Context must be destroyed if it is nolonger used. The user application *must*
 // ensure all components rely on the context is release before calling to this
@@ -243,9 +529,11 @@ struct CuvkEvaluationInvocation {
   // that used to create CUVK context, otherwise it will lead to undefined
   // behavior.
   CuvkSize height;
-  // Simulated universes.
+  // Simulated universes, in the format specified at context creation.
+  // Optional. The rendered universes are copied back only if this is not
+  // `nullptr`; costs are computed either way.
   L_OUT void* pSimUnivs;
-  // Real universe.
+  // Real universe, in 32-bit floats. Ignored if `realUniv` is given.
   const void* pRealUniv;
   // Number of universes in `pSimUnivs`.
   CuvkSize nSimUniv;
@@ -253,6 +541,41 @@ struct CuvkEvaluationInvocation {
   CuvkSize baseUniv;
   // Costs.
   L_OUT void* pCosts;
+  // Bacteria that differ from the base universe, tagged with the IDs of the
+  // simulated universes they are in. A cell should be given in both its states
+  // in the base universe and in the simulated universe, if it has moved. If
+  // this field is not `nullptr`, the evaluation is incremental. See 8.1.3 for
+  // details.
+  const void* pDirtyBacs;
+  // Number of bacteria in `pDirtyBacs`.
+  CuvkSize nDirtyBac;
+  // Resident real universe. Optional; `pRealUniv` is sent if this is `nullptr`.
+  CuvkRealUniverse realUniv;
+  // Resident real universe each simulated universe is compared against, in
+  // `nSimUniv` elements. Optional; if given, `pRealUniv` and `realUniv` are
+  // ignored. Can't be used in incremental evaluation.
+  const CuvkRealUniverse* pRealUnivs;
+  // Regions of interest, in `(x, y, width, height)` of 32-bit unsigned
+  // integers in pixels. Optional. See 8.1.2.1 for details.
+  const void* pRois;
+  // Number of rectangles in `pRois`. Either 1, shared by all simulated
+  // universes, or `nSimUniv`, one for each of them.
+  CuvkSize nRoi;
+  // Fraction of simulated universes with the lowest coarse costs to be refined
+  // at full resolution. See 8.1.2.2 for details.
+  float refineRatio;
+  // Simulated universes with coarse costs under this bound are refined at full
+  // resolution, regardless of `refineRatio`.
+  float refineBound;
+  // Number of simulated universes with the lowest costs to be output. Optional;
+  // all universes are output if this is 0. See 8.1.2.3 for details.
+  CuvkSize topK;
+  // IDs of the selected universes relative to `baseUniv`, in `topK` 32-bit
+  // unsigned integers. Required if `topK` is non-zero.
+  L_OUT void* pTopUnivs;
+  // Simulated universes of costs over this threshold are rejected. Optional;
+  // non-positive values disable rejection. See 8.1.2.4 for details.
+  float costThreshold;
 };
 L_EXPORT CuvkResult L_STDCALL cuvkInvokeEvaluation(
   CuvkContext context,
@@ -263,8 +586,138 @@ L_EXPORT CuvkResult L_STDCALL cuvkInvokeEvaluation(
 // Fails when:
 // - Unexpected failure occurs.
 //
-// **NOTE** The invocation will not check if all the bacteria are in the drawn
-// universes.
+// **NOTE** Bacteria don't have to be sorted by universe ID; they are bucketed
+// on device. Bacteria that are not in the drawn universes are ignored.
+//
+// **NOTE** Hypotheses against several frames can be scored in a single
+// evaluation by registering the frames as resident real universes (see 7.3),
+// and choosing one for each simulated universe in `pRealUnivs`.
+//
+// ##### 8.1.2.1 Regions of Interest
+//
+// Cells usually occupy a small part of the universe. If regions of interest
+// (ROIs) are given, simulated universes are only drawn within the bounding
+// rectangle of all ROIs, and the cost of each universe is only computed within
+// its ROI. The simulated universe is regarded as empty out of its ROI, so the
+// cost there is the sum of the real universe, which is added analytically. The
+// same rule applies in both cost modes. ROIs can't be used in incremental
+// evaluation.
+//
+// Only the bounding rectangle of all ROIs is copied to `pSimUnivs`, unless the
+// universes are bit-packed; other pixels are left undefined.
+//
+// ##### 8.1.2.2 Coarse-to-Fine Evaluation
+//
+// Most candidate universes are obviously worse than the others. If the context
+// is created with a non-zero `coarseLevel`, and either `refineRatio` or
+// `refineBound` is positive, all simulated universes are first drawn and
+// costed at a reduced resolution, against a real universe downsampled on
+// device. Only the universes passing either criterion are then evaluated at
+// full resolution; the others get their coarse costs, scaled to the full
+// resolution, as estimates.
+//
+// Universes are selected, and their bacteria renumbered, on device; the host
+// only reads back the coarse costs and the selection between the passes. The
+// downsampled real universes of a resident real universe are built on
+// registration; those of a sent-along real universe are built on each
+// evaluation.
+//
+// Coarse-to-fine evaluation can't be incremental, nor be used with ROIs,
+// `pRealUnivs` or `pSimUnivs`. Rendered universes can't be fetched from a
+// coarse-to-fine evaluation task.
+//
+// ##### 8.1.2.3 Top-K Selection
+//
+// An optimizer usually keeps only the best few of the candidate universes. If
+// `topK` is non-zero, costs are ranked on device, and only the `topK`
+// universes with the lowest costs are read back, in ascending order of cost.
+// Ties are broken by universe ID. `pTopUnivs` receives their IDs, and
+// `pCosts` and `pSimUnivs`, if given, receive their costs and rendered
+// universes in the same order, so they only need room for `topK` universes.
+// Top-K selection can't be used in coarse-to-fine evaluation.
+//
+// Rendered universes not selected can still be fetched with
+// `cuvkFetchUniverse`.
+//
+// ##### 8.1.2.4 Early Rejection
+//
+// Candidates worse than a known cost, e.g. the best cost so far, are usually
+// of no interest. If `costThreshold` is positive, simulated universes of costs
+// over it are rejected, and are reported with costs of positive infinity
+// instead of their exact costs. When costs are computed over the entire
+// universes, i.e. neither in incremental evaluation, with ROIs, nor in
+// coverage mode, the sections of a universe publish their partial sums as they
+// finish, and the remaining sections of a universe are skipped as soon as the
+// partial sums exceed the threshold.
+//
+// The universes not refined in coarse-to-fine evaluation are not rejected, as
+// their costs are estimates.
+//
+// #### 8.1.3 Incremental Evaluation
+//
+// Candidate universes usually differ from a known universe (the base universe)
+// by only a few cells. A base evaluation draws the base universe and computes
+// its cost. Both are kept resident in the context until the next base
+// evaluation.
+//
+struct CuvkBaseEvaluationInvocation {
+  // Bacteria data buffer of the base universe.
+  const void* pBacs;
+  // Number of bacteria in `pBacs`.
+  CuvkSize nBac;
+  // Width of the base universe. Must use the same value as that used to create
+  // CUVK context.
+  CuvkSize width;
+  // Height of the base universe. Must use the same value as that used to create
+  // CUVK context.
+  CuvkSize height;
+  // Real universe. Ignored if `realUniv` is given.
+  const void* pRealUniv;
+  // ID of the base universe. All bacteria in `pBacs` must be in this universe.
+  CuvkSize univ;
+  // Cost of the base universe as output. Optional.
+  L_OUT void* pCost;
+  // Resident real universe. Optional; `pRealUniv` is sent if this is `nullptr`.
+  CuvkRealUniverse realUniv;
+};
+L_EXPORT CuvkResult L_STDCALL cuvkInvokeBaseEvaluation(
+  CuvkContext context,
+  const CuvkBaseEvaluationInvocation* pInvocation,
+  L_OUT CuvkTask* pTask
+);
+//
+// Fails when:
+// - Unexpected failure occurs.
+//
+// Evaluations with `pDirtyBacs` given are then incremental. Simulated universes
+// are still drawn as a whole, but in each of them only the union of bounding
+// boxes of dirty cells is re-costed, against the base universe. The costs are
+// given as the base cost plus the difference.
+//
+// **NOTE** Incremental evaluations *must* use the same real universe as that
+// of the base evaluation. If there is no finished base evaluation, incremental
+// evaluations fail.
+//
+// #### 8.1.4 Batching
+//
+// Invocations larger than the batch sizes given at context creation are split
+// into batches, which are run one after another through the same device
+// memory. Results are written to the user application's buffers as if there
+// were one batch.
+//
+// - Deformations are split by both deform specs and bacteria.
+// - Evaluations are split by simulated universes, so that each batch has at
+//   most `nuniv` universes, and no more bacteria than evaluation buffers can
+//   grow to hold. They grow up to device limits, so bacteria only split
+//   evaluations that exceed the limits or the available memory. A single
+//   universe with more bacteria than that fails the task.
+//
+// Host-side preparation of the next batch, and the upload of its bacteria,
+// overlap with the device working on the current one. Bacteria input of
+// evaluations is therefore given memory of two batches. Top-K selection and
+// coarse-to-fine evaluation can't be split, and base evaluations must fit in
+// one batch. Rendered universes can't be fetched from a task of multiple
+// batches.
 //
 // ## 8.3 Polling
 //
@@ -283,7 +736,34 @@ L_EXPORT CuvkTaskStatus L_STDCALL cuvkPoll(
 // **WARN** If a task failed to complete, the result is invalid. User
 // applications *must not* rely on results of failed execution.
 //
-// ## 8.4 Task Destruction
+// ## 8.4 Universe Readback
+//
+// Rendered universes of a finished evaluation task are kept on device until the
+// next evaluation task is submitted. The user application can fetch individual
+// universes on demand, instead of having all of them copied back through
+// `pSimUnivs`.
+//
+L_EXPORT CuvkResult L_STDCALL cuvkFetchUniverse(
+  CuvkTask task,
+  CuvkSize index,
+  L_OUT void* pDst
+);
+//
+// `index` is the index of universe in the simulated universes of the
+// invocation, i.e. the universe ID minus `baseUniv`. The universe is written to
+// `pDst` in the format specified at context creation.
+//
+// Universes of coarse-to-fine evaluation, and of evaluation split into multiple
+// batches, are not kept and can't be fetched.
+//
+// Fails when:
+// - The task is not a finished evaluation task.
+// - Another evaluation task has been submitted since then.
+// - The task is coarse-to-fine or has been split into batches.
+// - `index` is out of range.
+// - Unexpected failure occurs.
+//
+// ## 8.5 Task Destruction
 //
 // Every task must be destructed when unused. The user application *should*
 // ensure the task has completed; otherwise this call will block the current
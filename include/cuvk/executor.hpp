@@ -78,7 +78,7 @@ enum class CommandRecorderStatus {
 struct CommandRecorder {
   const Executable* exec;
 
-  VkPipelineStageFlagBits cur;
+  VkPipelineStageFlags cur;
   std::array<VkImageMemoryBarrier, 4> imbs;
   uint32_t nimb;
   std::array<VkBufferMemoryBarrier, 4> bmbs;
@@ -91,13 +91,13 @@ struct CommandRecorder {
   bool end() noexcept;
   ~CommandRecorder() noexcept;
 
-  CommandRecorder& from_stage(VkPipelineStageFlagBits stage) noexcept;
+  CommandRecorder& from_stage(VkPipelineStageFlags stages) noexcept;
   CommandRecorder& barrier(const ImageSlice& img_slice,
     VkAccessFlags src_access, VkAccessFlags dst_access,
     VkImageLayout old_layout, VkImageLayout new_layout) noexcept;
   CommandRecorder& barrier(const BufferSlice& buf_slice,
     VkAccessFlags src_access, VkAccessFlags dst_access) noexcept;
-  CommandRecorder& to_stage(VkPipelineStageFlagBits stage) noexcept;
+  CommandRecorder& to_stage(VkPipelineStageFlags stages) noexcept;
 
   CommandRecorder& copy_buf_to_buf(
     const BufferSlice& src, const BufferSlice& dst) noexcept;
@@ -105,8 +105,16 @@ struct CommandRecorder {
     const BufferSlice& src, const ImageSlice& dst) noexcept;
   CommandRecorder& copy_img_to_buf(
     const ImageSlice& src, const BufferSlice& dst) noexcept;
+  // Copy only `rect` of each layer. `dst` is where the first pixel of `rect` is
+  // copied to, in a buffer of whole images.
+  CommandRecorder& copy_img_to_buf(
+    const ImageSlice& src, const BufferSlice& dst,
+    const VkRect2D& rect) noexcept;
   CommandRecorder& copy_img_to_img(
     const ImageSlice& src, const ImageSlice& dst) noexcept;
+  // Fill the buffer slice with repeated 4-byte `data`. The slice size must be a
+  // multiple of 4.
+  CommandRecorder& fill_buf(const BufferSlice& dst, uint32_t data) noexcept;
 
   CommandRecorder& push_const(
     const ComputePipeline& comp_pipe,
@@ -126,6 +134,14 @@ struct CommandRecorder {
     std::optional<const DescriptorSet*> desc_set,
     const BufferSlice& vert_buf, uint32_t nvert,
     const Framebuffer& framebuf) noexcept;
+  // Draw with the command at `draw_cmd`, which is a `VkDrawIndirectCommand`.
+  // Fragments out of `scissor` are discarded if it's given.
+  CommandRecorder& draw_indirect(
+    const GraphicsPipeline& graph_pipe,
+    std::optional<const DescriptorSet*> desc_set,
+    const BufferSlice& vert_buf, const BufferSlice& draw_cmd,
+    const Framebuffer& framebuf,
+    std::optional<VkRect2D> scissor) noexcept;
 };
 
 struct Executable {
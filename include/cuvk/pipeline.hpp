@@ -11,6 +11,7 @@ struct ShaderManager;
 
 struct DescriptorSetLayout;
 struct DecsriptorSet;
+struct Sampler;
 
 struct RenderPass;
 struct FramebufferRequirements;
@@ -93,6 +94,25 @@ struct DescriptorSetLayout {
 
 
 
+// Samplers in CUVK are only used to fetch texels (`texelFetch`), so filtering
+// and addressing are fixed.
+struct Sampler {
+  const Context* ctxt;
+
+  VkSampler sampler;
+
+  Sampler(const Context& ctxt) noexcept;
+  bool make() noexcept;
+  void drop() noexcept;
+  ~Sampler() noexcept;
+
+  Sampler(const Sampler&) = delete;
+  Sampler& operator=(const Sampler&) = delete;
+  Sampler(Sampler&&) noexcept;
+};
+
+
+
 struct DescriptorSet {
   const Context* ctxt;
   const DescriptorSetLayout* desc_set_layout;
@@ -114,6 +134,9 @@ struct DescriptorSet {
   DescriptorSet& write(
     uint32_t bind_pt, const ImageView& img_view, VkImageLayout layout,
     VkDescriptorType desc_type) noexcept;
+  DescriptorSet& write(
+    uint32_t bind_pt, const ImageView& img_view, const Sampler& sampler,
+    VkImageLayout layout, VkDescriptorType desc_type) noexcept;
 };
 
 
@@ -167,6 +190,9 @@ struct GraphicsPipelineRequirements {
 };
 struct ComputePipelineRequirements {
   std::optional<std::array<uint32_t, 3>> local_workgrp;
+  // Extra specialization constants in pairs of constant ID and value. Constant
+  // IDs 1 to 3 are reserved for local workgroup sizes.
+  std::vector<std::pair<uint32_t, uint32_t>> spec_consts = {};
 };
 
 
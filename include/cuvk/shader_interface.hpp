@@ -26,6 +26,23 @@ struct Bacterium {
 };
 static_assert(sizeof(Bacterium) == 24);
 
+// Pixel-aligned rectangle in a universe. Empty if either extent is zero.
+struct Rect {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+};
+static_assert(sizeof(Rect) == 16);
+
+// Universe selected in top-K selection.
+struct TopUniverse {
+  // Universe ID, relative to the first universe evaluated.
+  uint32_t univ;
+  float cost;
+};
+static_assert(sizeof(TopUniverse) == 8);
+
 }
 
 L_CUVK_END_
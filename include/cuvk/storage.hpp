@@ -2,7 +2,9 @@
 #include "cuvk/comdef.hpp"
 #include "cuvk/config.hpp"
 #include "cuvk/span.hpp"
+#include <algorithm>
 #include <map>
+#include <mutex>
 #include <vulkan/vulkan.h>
 
 L_CUVK_BEGIN_
@@ -23,6 +25,9 @@ struct HostOutputMemoryView;
 
 struct HeapAllocation;
 struct DeviceMemorySlice;
+struct ArenaRange;
+struct HeapStatistics;
+struct HeapArena;
 
 struct BufferAllocationRequirements;
 struct BufferAllocation;
@@ -67,6 +72,10 @@ template<typename TSize>
 struct Sizer {
 private:
   TSize _offset = 0;
+  // The furthest offset reached before rewinding.
+  TSize _peak = 0;
+  // Size of all allocations as if none were aliased.
+  TSize _total = 0;
 
 public:
   // Prepare space for `size` aligned.
@@ -75,14 +84,28 @@ public:
     auto offset = _offset;
     size = detail::align<TSize>(size * sizeof(TElem), alignment);
     _offset += size;
+    _total += size;
     return {
       offset,
       size,
     };
   }
-  operator TSize() const {
+  // Offset of the next allocation, to be rewound to.
+  TSize mark() const {
     return _offset;
   }
+  // Allocate from `mark` again. Allocations after rewinding alias the ones
+  // made since `mark`, so their lifetimes must not overlap.
+  void rewind(TSize mark) {
+    _peak = std::max(_peak, _offset);
+    _offset = mark;
+  }
+  TSize total() const {
+    return _total;
+  }
+  operator TSize() const {
+    return std::max(_peak, _offset);
+  }
 };
 
 
@@ -98,10 +121,75 @@ struct HostOutputMemoryView {
 
 
 
+// A block of device memory. Host-visible blocks are mapped once on allocation
+// and kept mapped until they are freed.
 struct HeapAllocation {
   const Context* ctxt;
   VkDeviceSize alloc_size;
   VkDeviceMemory dev_mem;
+  // Host address of the entire block, or `nullptr` if it's not host-visible.
+  void* mapped;
+  // Host writes and device writes need to be flushed and invalidated
+  // explicitly if the block is not host-coherent.
+  bool is_coherent;
+};
+// A range of device memory sub-allocated by a heap arena.
+struct ArenaRange {
+  HeapAllocation* block;
+  VkDeviceSize offset;
+  // Requested size of the range.
+  VkDeviceSize size;
+  // Size class of the range, or `HeapArena::DEDICATED` if the range owns its
+  // block.
+  uint32_t size_class;
+};
+struct HeapStatistics {
+  // Number of blocks allocated from the driver.
+  uint32_t nblock;
+  // Bytes allocated from the driver.
+  VkDeviceSize reserved;
+  // Bytes requested by living resources.
+  VkDeviceSize used;
+  // Bytes lost to rounding living ranges up to their size classes.
+  VkDeviceSize internal_frag;
+  // Bytes of freed ranges waiting in free lists to be reused.
+  VkDeviceSize free;
+  // Bytes never handed out at the end of the current block.
+  VkDeviceSize remaining;
+};
+// Device memory of a single memory type. The first block holds resources
+// declared before `HeapManager::make`, packed tightly. Resources allocated
+// afterwards are placed in blocks of `ARENA_BLOCK_SIZE` chained one after
+// another, in ranges rounded up to power-of-2 size classes. Freed ranges are
+// kept in free lists of their size classes for reuse. Requests larger than the
+// largest size class are given dedicated blocks, which are released on free.
+struct HeapArena {
+  static constexpr uint32_t DEDICATED = ~0u;
+
+  const Context* ctxt;
+  VkMemoryPropertyFlags mem_props;
+  uint32_t mem_type_idx;
+
+  std::list<HeapAllocation> blocks;
+  // The block ranges are currently bumped from, and the bump cursor in it.
+  HeapAllocation* cur_block;
+  VkDeviceSize cursor;
+  std::array<std::vector<ArenaRange>, ARENA_NCLASS> free_lists;
+
+  VkDeviceSize used;
+  VkDeviceSize internal_frag;
+  VkDeviceSize free;
+
+  HeapArena(const Context& ctxt, VkMemoryPropertyFlags mem_props,
+    uint32_t mem_type_idx) noexcept;
+
+  // Allocate a block of `size` bytes from the driver.
+  HeapAllocation* alloc_block(VkDeviceSize size) noexcept;
+  std::optional<ArenaRange> allocate(
+    VkDeviceSize size, VkDeviceSize alignment) noexcept;
+  void free_range(const ArenaRange& range) noexcept;
+  HeapStatistics statistics() const noexcept;
+  void drop() noexcept;
 };
 struct DeviceMemorySlice {
   const HeapAllocation* heap_alloc;
@@ -116,8 +204,18 @@ struct DeviceMemorySlice {
   // Wipe out the memory with 0.
   bool wipe() const noexcept;
 
+  // Get the host address of the first `size` bytes, with device writes made
+  // visible to the host.
   void* map(size_t size) const noexcept;
+  // Make host writes to the slice visible to the device. The memory stays
+  // mapped.
   void unmap() const noexcept;
+  // Make host writes to the first `size` bytes visible to the device. No-op
+  // for host-coherent memory.
+  bool flush(size_t size) const noexcept;
+  // Make device writes to the first `size` bytes visible to the host. No-op
+  // for host-coherent memory.
+  bool invalidate(size_t size) const noexcept;
 };
 
 
@@ -189,6 +287,9 @@ struct BufferAllocation {
 
   VkBuffer buf;
   VkDeviceSize offset;
+  // The range the buffer is bound to, if it's allocated after
+  // `HeapManager::make`.
+  std::optional<ArenaRange> arena_range = std::nullopt;
 
   BufferSlice slice(VkDeviceSize offset, VkDeviceSize size) const noexcept;
   BufferSlice slice(RawBufferSlice slice) const noexcept;
@@ -231,10 +332,15 @@ struct HeapManager {
   std::vector<VkMemoryType> mem_types;
   std::vector<VkMemoryHeap> mem_heaps;
 
-  // Memory type index to heap allocation mapping.
-  std::map<uint32_t, HeapAllocation> heap_allocs;
+  // Memory type index to heap arena mapping.
+  std::map<uint32_t, HeapArena> arenas;
+  // Host allocations imported as device memory, one for each imported buffer.
+  std::list<HeapAllocation> imported_blocks;
   std::list<BufferAllocation> buf_allocs;
   std::list<ImageAllocation> img_allocs;
+  // Guards resources allocated after `make`, which can be allocated and freed
+  // by tasks on different threads.
+  std::mutex sync;
 
   HeapManager(const Context& ctxt) noexcept;
   bool make() noexcept;
@@ -255,7 +361,30 @@ struct HeapManager {
     VkImageUsageFlags usage, VkImageTiling tiling,
     MemoryVisibility visibility) noexcept;
 
+  // Create a buffer after `make`, sub-allocated from the arena of its memory
+  // type. Returns `nullptr` on failure. Buffers can be grown by allocating a
+  // larger one and freeing the old one.
+  const BufferAllocation* alloc_buf(
+    size_t size, VkBufferUsageFlags usage,
+    MemoryVisibility visibility) noexcept;
+  // Create a buffer bound to host memory at `host_ptr`, which must be aligned
+  // to `minImportedHostPointerAlignment`, by `VK_EXT_external_memory_host`.
+  // `size` is rounded up to the alignment, so the host allocation must be
+  // padded too. Returns `nullptr` if the memory can't be imported.
+  const BufferAllocation* import_buf(
+    void* host_ptr, size_t size, VkBufferUsageFlags usage) noexcept;
+  // Destroy a buffer created by `alloc_buf` or `import_buf`, and release its
+  // memory.
+  void free_buf(const BufferAllocation& buf_alloc) noexcept;
+  // Statistics of all arenas.
+  HeapStatistics statistics() const noexcept;
+  // Statistics of the arenas of memory types in heap `mem_heap_idx`.
+  HeapStatistics statistics(uint32_t mem_heap_idx) const noexcept;
+
 private:
+  void drop_buf(const BufferAllocation& buf_alloc) noexcept;
+  HeapArena* find_arena(const VkMemoryRequirements& mem_req,
+    MemoryVisibility visibility) noexcept;
   bool make_rscs() noexcept;
   bool make_bufs() noexcept;
   bool make_imgs() noexcept;
@@ -0,0 +1,52 @@
+#pragma once
+#include "cuvk/comdef.hpp"
+#include "cuvk/config.hpp"
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+L_CUVK_BEGIN_
+
+// Direction of a host transfer between host memory and mapped device memory.
+// Mapped device memory is usually write-combined or uncached, and is not
+// accessed again by the host soon, so it's written with non-temporal stores and
+// read with non-temporal loads on x86.
+enum class TransferDirection {
+  ToDevice, FromDevice,
+};
+
+// Copies host transfers. Transfers of at least `TRANSFER_PARALLEL_THRESHOLD`
+// bytes are split across worker threads; smaller ones are made on the calling
+// thread, as do all transfers if the engine is not made.
+struct TransferEngine {
+  std::vector<std::thread> workers;
+  std::queue<std::packaged_task<void()>> jobs;
+  std::mutex sync;
+  std::condition_variable cv;
+  bool stop;
+
+  TransferEngine() noexcept;
+  bool make() noexcept;
+  void drop() noexcept;
+  ~TransferEngine() noexcept;
+
+  TransferEngine(const TransferEngine&) = delete;
+  TransferEngine& operator=(const TransferEngine&) = delete;
+
+  void copy(L_OUT void* dst, const void* src, size_t size,
+    TransferDirection dir) noexcept;
+};
+
+// Copy on the calling thread, with non-temporal instructions if `size` is at
+// least `TRANSFER_STREAM_THRESHOLD`.
+void transfer_chunk(L_OUT void* dst, const void* src, size_t size,
+  TransferDirection dir) noexcept;
+
+/*
+ * Global transfer engine instance.
+ */
+extern TransferEngine TRANSFER;
+
+L_CUVK_END_
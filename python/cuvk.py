@@ -46,12 +46,68 @@ class Bacterium(Structure):
     def __repr__(self):
         return "[position=(%f, %f), size=(%f,%f), orientation=%f, universe=%d]" % (self.x, self.y, self.length, self.width, self.orient, self.univ)
 
+SIM_UNIV_FORMAT_FLOAT32 = 0
+SIM_UNIV_FORMAT_UNORM8 = 1
+SIM_UNIV_FORMAT_BIT = 2
+
+COST_MODE_FULL_FRAME = 0
+COST_MODE_COVERAGE = 1
+
+COST_METRIC_L1 = 0
+COST_METRIC_L2 = 1
+COST_METRIC_TRUNCATED_L1 = 2
+COST_METRIC_IOU = 3
+COST_METRIC_DICE = 4
+
+INPUT_PLACEMENT_AUTO = 0
+INPUT_PLACEMENT_DIRECT = 1
+INPUT_PLACEMENT_STAGED = 2
+
 class MemoryRequirements(Structure):
     _fields_ = [('nspec', c_uint),
                 ('nbac', c_uint),
                 ('nuniv', c_uint),
                 ('width', c_uint),
-                ('height', c_uint)]
+                ('height', c_uint),
+                ('sim_univ_format', c_uint),
+                ('cost_mode', c_uint),
+                ('nreal_univ', c_uint),
+                ('coarse_level', c_uint),
+                ('cost_metric', c_uint),
+                ('truncation', c_float),
+                ('use_weight_map', c_uint),
+                ('input_placement', c_uint)]
+
+class MemoryBreakdown(Structure):
+    _fields_ = [('host_visible_size', c_uint64),
+                ('device_only_size', c_uint64),
+                ('image_size', c_uint64)]
+
+MAX_MEMORY_HEAP_COUNT = 16
+
+class MemoryHeapStats(Structure):
+    _fields_ = [('size', c_uint64),
+                ('device_local', c_uint),
+                ('context_usage', c_uint64),
+                ('process_usage', c_uint64),
+                ('budget', c_uint64)]
+
+class MemoryStats(Structure):
+    _fields_ = [('nheap', c_uint),
+                ('heaps', MemoryHeapStats * MAX_MEMORY_HEAP_COUNT),
+                ('breakdown', MemoryBreakdown)]
+
+def sim_univ_buffer(sim_univ_format, nsim_univ, univ_size):
+    """
+    Make a buffer for `nsim_univ` simulated universes of `univ_size` pixels in
+    the given format.
+    """
+    if sim_univ_format == SIM_UNIV_FORMAT_UNORM8:
+        return (c_ubyte * (nsim_univ * univ_size))()
+    elif sim_univ_format == SIM_UNIV_FORMAT_BIT:
+        return (c_uint * (nsim_univ * ((univ_size + 31) // 32)))()
+    else:
+        return (c_float * (nsim_univ * univ_size))()
 
 class DeformationInvocation(Structure):
     _fields_ = [('deform_specs', POINTER(DeformSpecs)),
@@ -61,15 +117,20 @@ class DeformationInvocation(Structure):
                 ('base_univ', c_uint),
                 ('nuniv', c_uint),
                 ('bacs_out', POINTER(Bacterium))]
-    def __init__(self, specs, bacs, base_univ, nuniv):
+    def __init__(self, specs, bacs, base_univ, nuniv, ctxt=None):
+        def alloc(ty, n):
+            if ctxt is None:
+                return (ty * n)()
+            return HostBuffer(ctxt, ty, n).array
+
         self.nspec = len(specs)
-        self.specs_buf = (DeformSpecs * self.nspec)()
+        self.specs_buf = alloc(DeformSpecs, self.nspec)
         for i in range(self.nspec):
             self.specs_buf[i] = specs[i]
         self.deform_specs = cast(self.specs_buf, POINTER(DeformSpecs))
 
         self.nbac = len(bacs)
-        self.bacs_buf = (Bacterium * self.nbac)()
+        self.bacs_buf = alloc(Bacterium, self.nbac)
         for i in range(self.nbac):
             self.bacs_buf[i] = bacs[i]
         self.bacs = cast(self.bacs_buf, POINTER(Bacterium))
@@ -77,7 +138,7 @@ class DeformationInvocation(Structure):
         self.base_univ = c_uint(base_univ)
         self.nuniv = c_uint(nuniv)
 
-        self.bacs_out_buf = (Bacterium * (self.nbac * self.nspec))()
+        self.bacs_out_buf = alloc(Bacterium, self.nbac * self.nspec)
         self.bacs_out = cast(self.bacs_out_buf, POINTER(Bacterium))
 
 class EvaluationInvocation(Structure):
@@ -89,8 +150,19 @@ class EvaluationInvocation(Structure):
                 ('real_univ', POINTER(c_float)),
                 ('nsim_univ', c_uint),
                 ('base_sim_univ', c_uint),
-                ('costs', POINTER(c_float))]
-    def __init__(self, bacs, width, height, real_univ, base_sim_univ, nsim_univ):
+                ('costs', POINTER(c_float)),
+                ('dirty_bacs', POINTER(Bacterium)),
+                ('ndirty_bac', c_uint),
+                ('real_univ_handle', c_void_p),
+                ('real_univ_handles', POINTER(c_void_p)),
+                ('rois', POINTER(c_uint)),
+                ('nroi', c_uint),
+                ('refine_ratio', c_float),
+                ('refine_bound', c_float),
+                ('topk', c_uint),
+                ('top_univs', POINTER(c_uint)),
+                ('cost_threshold', c_float)]
+    def __init__(self, bacs, width, height, real_univ, base_sim_univ, nsim_univ, dirty_bacs=None, sim_univ_format=SIM_UNIV_FORMAT_FLOAT32, fetch_sim_univs=True, rois=None, refine_ratio=0.0, refine_bound=0.0, topk=0, cost_threshold=0.0):
         self.nbac = len(bacs)
         self.bacs_buf = (Bacterium * self.nbac)()
         for i in range(self.nbac):
@@ -100,20 +172,97 @@ class EvaluationInvocation(Structure):
         self.width = width
         self.height = height
 
-        univ_size = len(real_univ)
-
-        self.real_univ_buf = (c_float * (univ_size))()
-        for i in range(univ_size):
-            self.real_univ_buf[i] = real_univ[i]
-        self.real_univ = cast(self.real_univ_buf, POINTER(c_float))
+        if isinstance(real_univ, RealUniverse):
+            univ_size = width * height
+            self.real_univ_handle = real_univ._handle
+        elif len(real_univ) > 0 and isinstance(real_univ[0], RealUniverse):
+            # A real universe for each simulated universe.
+            univ_size = width * height
+            self.real_univ_handles_buf = (c_void_p * len(real_univ))()
+            for i in range(len(real_univ)):
+                self.real_univ_handles_buf[i] = real_univ[i]._handle
+            self.real_univ_handles = cast(self.real_univ_handles_buf, POINTER(c_void_p))
+        else:
+            univ_size = len(real_univ)
+            self.real_univ_buf = (c_float * (univ_size))()
+            for i in range(univ_size):
+                self.real_univ_buf[i] = real_univ[i]
+            self.real_univ = cast(self.real_univ_buf, POINTER(c_float))
 
         self.base_sim_univ = base_sim_univ
         self.nsim_univ = nsim_univ
 
-        self.sim_univs_buf = (c_float * (nsim_univ * univ_size))()
-        self.sim_univs = cast(self.sim_univs_buf, POINTER(c_float))
-        self.costs_buf = (c_float * nsim_univ)()
+        # Only the selected universes are output in top-K selection.
+        nout_univ = topk if topk != 0 else nsim_univ
+        if fetch_sim_univs:
+            self.sim_univs_buf = sim_univ_buffer(sim_univ_format, nout_univ, univ_size)
+            self.sim_univs = cast(self.sim_univs_buf, POINTER(c_float))
+        else:
+            self.sim_univs_buf = None
+            self.sim_univs = None
+        self.costs_buf = (c_float * nout_univ)()
         self.costs = cast(self.costs_buf, POINTER(c_float))
+        self.topk = topk
+        if topk != 0:
+            self.top_univs_buf = (c_uint * topk)()
+            self.top_univs = cast(self.top_univs_buf, POINTER(c_uint))
+        else:
+            self.top_univs_buf = None
+
+        self.cost_threshold = cost_threshold
+
+        if dirty_bacs is not None:
+            self.ndirty_bac = len(dirty_bacs)
+            self.dirty_bacs_buf = (Bacterium * max(self.ndirty_bac, 1))()
+            for i in range(self.ndirty_bac):
+                self.dirty_bacs_buf[i] = dirty_bacs[i]
+            self.dirty_bacs = cast(self.dirty_bacs_buf, POINTER(Bacterium))
+
+        if rois is not None:
+            # Each ROI is in `(x, y, width, height)`.
+            self.nroi = len(rois)
+            self.rois_buf = (c_uint * (4 * self.nroi))()
+            for i in range(self.nroi):
+                for j in range(4):
+                    self.rois_buf[i * 4 + j] = rois[i][j]
+            self.rois = cast(self.rois_buf, POINTER(c_uint))
+
+        self.refine_ratio = refine_ratio
+        self.refine_bound = refine_bound
+
+class BaseEvaluationInvocation(Structure):
+    _fields_ = [('bacs', POINTER(Bacterium)),
+                ('nbac', c_uint),
+                ('width', c_uint),
+                ('height', c_uint),
+                ('real_univ', POINTER(c_float)),
+                ('univ', c_uint),
+                ('cost', POINTER(c_float)),
+                ('real_univ_handle', c_void_p)]
+    def __init__(self, bacs, width, height, real_univ, univ):
+        self.nbac = len(bacs)
+        self.bacs_buf = (Bacterium * max(self.nbac, 1))()
+        for i in range(self.nbac):
+            self.bacs_buf[i] = bacs[i]
+        self.bacs = cast(self.bacs_buf, POINTER(Bacterium))
+
+        self.width = width
+        self.height = height
+
+        if isinstance(real_univ, RealUniverse):
+            univ_size = width * height
+            self.real_univ_handle = real_univ._handle
+        else:
+            univ_size = len(real_univ)
+            self.real_univ_buf = (c_float * (univ_size))()
+            for i in range(univ_size):
+                self.real_univ_buf[i] = real_univ[i]
+            self.real_univ = cast(self.real_univ_buf, POINTER(c_float))
+
+        self.univ = univ
+
+        self.cost_buf = (c_float * 1)()
+        self.cost = cast(self.cost_buf, POINTER(c_float))
 
 def enumerate_physical_devices():
     size = c_int()
@@ -122,6 +271,15 @@ def enumerate_physical_devices():
     LIBCUVK.cuvkEnumeratePhysicalDevices(byref(size), 0)
     return phys_dev.value
 
+def estimate_memory(phys_dev_idx, mem_req):
+    """
+    Estimate memory a context would take without creating it. `mem_req` is
+    lowered to device limits in place.
+    """
+    estimate = MemoryBreakdown()
+    LIBCUVK.cuvkEstimateMemory(phys_dev_idx, byref(mem_req), byref(estimate))
+    return estimate
+
 
 class Task:
     NOT_READY = 0
@@ -188,37 +346,158 @@ class EvaluationTask(Task):
     def result(self):
         """
         Retrieve the result of the evaluation task. The type is a 2-tuple of the
-        simulated universes and the cost of each universe.
+        simulated universes and the cost of each universe. The simulated
+        universes are `None` if they were not fetched. In top-K selection, the
+        IDs of the selected universes are appended as the third element.
         """
         if self._status is self.NOT_READY:
             raise RuntimeError("Task result is not ready yet.")
         elif self._status is self.ERROR:
             raise RuntimeError("Error occurred during execution.")
+        elif self._invoke.topk != 0:
+            return (self._invoke.sim_univs_buf, self._invoke.costs_buf, self._invoke.top_univs_buf)
         else:
             return (self._invoke.sim_univs_buf, self._invoke.costs_buf)
 
+    def fetch_universe(self, index):
+        """
+        Fetch a single rendered universe of the finished evaluation task. Only
+        available until the next evaluation task is dispatched.
+        """
+        mem_req = self._ctxt.mem_req
+        buf = sim_univ_buffer(mem_req.sim_univ_format, 1, mem_req.width * mem_req.height)
+        if not LIBCUVK.cuvkFetchUniverse(self._handle, index, byref(buf)):
+            raise RuntimeError("Unable to fetch universe.")
+        return buf
+
+class BaseEvaluationTask(Task):
+    def __init__(self, ctxt, invoke):
+        if type(invoke) is not BaseEvaluationInvocation:
+            raise TypeError("`invoke` is not BaseEvaluationInvocation.")
+        task = c_void_p()
+        if not LIBCUVK.cuvkInvokeBaseEvaluation(
+            ctxt._handle, byref(invoke), byref(task)):
+            raise RuntimeError("Unable to create base evaluation task.")
+        super().__init__(ctxt, task, invoke)
+
+    def result(self):
+        """
+        Retrieve the result of the base evaluation task. The type is the cost of
+        the base universe.
+        """
+        if self._status is self.NOT_READY:
+            raise RuntimeError("Task result is not ready yet.")
+        elif self._status is self.ERROR:
+            raise RuntimeError("Error occurred during execution.")
+        else:
+            return self._invoke.cost_buf[0]
+
+
+class RealUniverse:
+    """
+    Real universe kept resident on device. Can be given in place of the pixel
+    list wherever a real universe is expected.
+    """
+    def __init__(self, ctxt, real_univ):
+        self.ctxt = ctxt
+        univ_size = len(real_univ)
+        real_univ_buf = (c_float * (univ_size))()
+        for i in range(univ_size):
+            real_univ_buf[i] = real_univ[i]
+        handle = c_void_p()
+        LIBCUVK.cuvkCreateRealUniverse(ctxt._handle, real_univ_buf, byref(handle))
+        self._handle = handle
+    def __del__(self):
+        LIBCUVK.cuvkDestroyRealUniverse(self.ctxt._handle, self._handle)
+
+
+class HostBuffer:
+    """
+    Buffer in host-visible device memory owned by the context. `array` is a
+    ctypes array of `n` elements of `ty` mapped to it, which keeps the buffer
+    alive. Deformation inputs and outputs in it are accessed by the device in
+    place.
+    """
+    def __init__(self, ctxt, ty, n):
+        self.ctxt = ctxt
+        ptr = c_void_p()
+        if not LIBCUVK.cuvkAllocHostBuffer(ctxt._handle, sizeof(ty) * n, byref(ptr)):
+            raise RuntimeError("Unable to allocate host buffer.")
+        self._handle = ptr
+        self.array = (ty * n).from_address(ptr.value)
+        self.array._host_buf = self
+    def __del__(self):
+        LIBCUVK.cuvkFreeHostBuffer(self.ctxt._handle, self._handle)
+
 
 class Context:
     def __init__(self, phys_dev_idx, mem_req):
         self.inst = CUVK
+        self.mem_req = mem_req
         ctxt = c_void_p()
         LIBCUVK.cuvkCreateContext(phys_dev_idx, byref(mem_req), byref(ctxt))
         self._handle = ctxt
     def __del__(self):
         LIBCUVK.cuvkDestroyContext(self._handle)
 
-    def deform(self, specs, bacs, base_univ, nuniv):
+    def memory_stats(self):
+        """
+        Query memory usage and budget of each memory heap, and memory taken by
+        each resource of the context.
+        """
+        stats = MemoryStats()
+        LIBCUVK.cuvkQueryMemoryStats(self._handle, byref(stats))
+        return stats
+
+    def register_real_univ(self, real_univ):
+        """
+        Keep the real universe resident on device. The returned handle can be
+        passed as `real_univ` to evaluations to avoid uploading it each time.
+        """
+        return RealUniverse(self, real_univ)
+
+    def set_weight_map(self, weight_map):
+        """
+        Weight the cost of each pixel. The context must be created with
+        `use_weight_map`.
+        """
+        univ_size = len(weight_map)
+        weight_map_buf = (c_float * (univ_size))()
+        for i in range(univ_size):
+            weight_map_buf[i] = weight_map[i]
+        return LIBCUVK.cuvkSetWeightMap(self._handle, weight_map_buf)
+
+    def deform(self, specs, bacs, base_univ, nuniv, host_buffers=False):
         """
         Dispatch deformation task. Returns a dispatched deformation task whose
-        result is a list of deformed bacteria.
+        result is a list of deformed bacteria. If `host_buffers` is set, inputs
+        and outputs are placed in host buffers so that they are not copied.
         """
-        invoke = DeformationInvocation(specs, bacs, base_univ, nuniv)
+        invoke = DeformationInvocation(specs, bacs, base_univ, nuniv, self if host_buffers else None)
         return DeformationTask(self, invoke)
 
-    def eval(self, bacs, width, height, real_univ, base_sim_univ, nsim_univ):
+    def eval(self, bacs, width, height, real_univ, base_sim_univ, nsim_univ, dirty_bacs=None, fetch_sim_univs=True, rois=None, refine_ratio=0.0, refine_bound=0.0, topk=0, cost_threshold=0.0):
         """
-        Dispatch evaluation task
+        Dispatch evaluation task. If `dirty_bacs` is given, the evaluation is
+        incremental to the last base evaluation. Simulated universes are only
+        copied back if `fetch_sim_univs` is set. `real_univ` can be a list of
+        registered real universes, one for each simulated universe. `rois` is a
+        list of `(x, y, width, height)`, either one shared by all universes or
+        one for each of them. If `refine_ratio` or `refine_bound` is set and the
+        context has a coarse level, universes are costed coarsely first and only
+        the best ones are refined; `fetch_sim_univs` must be unset then. If
+        `topk` is non-zero, only the `topk` best universes are output. If
+        `cost_threshold` is positive, universes of higher costs are rejected
+        with infinite costs.
         """
-        invoke = EvaluationInvocation(bacs, width, height, real_univ, base_sim_univ, nsim_univ)
+        invoke = EvaluationInvocation(bacs, width, height, real_univ, base_sim_univ, nsim_univ, dirty_bacs, self.mem_req.sim_univ_format, fetch_sim_univs, rois, refine_ratio, refine_bound, topk, cost_threshold)
         return EvaluationTask(self, invoke)
 
+    def eval_base(self, bacs, width, height, real_univ, univ):
+        """
+        Dispatch base evaluation task, whose result is the cost of the base
+        universe.
+        """
+        invoke = BaseEvaluationInvocation(bacs, width, height, real_univ, univ)
+        return BaseEvaluationTask(self, invoke)
+
@@ -46,6 +46,13 @@ if __name__ == '__main__':
     mem_req.nuniv = UNIV_COUNT
     mem_req.width = UNIV_WIDTH
     mem_req.height = UNIV_HEIGHT
+    # Placement of evaluation inputs, one of `AUTO`, `DIRECT` and `STAGED`.
+    if "L_INPUT_PLACEMENT" in environ:
+        mem_req.input_placement = {
+            "AUTO": INPUT_PLACEMENT_AUTO,
+            "DIRECT": INPUT_PLACEMENT_DIRECT,
+            "STAGED": INPUT_PLACEMENT_STAGED,
+        }[environ["L_INPUT_PLACEMENT"]]
 
     ctxt = Context(0, mem_req)
 
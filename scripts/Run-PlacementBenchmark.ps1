@@ -0,0 +1,33 @@
+function CollectCuvk {
+    param([string] $placement)
+    function CaptureTime {
+        param ([int] $j, [string] $task)
+        $times =
+            Get-Content "bench_cuvk.$placement.$j.log" |
+            Select-String $task |
+            ForEach-Object { return [float](([string]$_).Substring(0, 12)) };
+        return $times[1] - $times[0];
+    }
+    $eval_list = @()
+    for ($j = 0; $j -lt 10; ++$j) {
+        $eval_list += CaptureTime $j "evaluation";
+    }
+    return ($eval_list | Measure-Object -Average).Average
+}
+
+
+
+
+$PSDefaultParameterValues = @{"Out-File:Encoding"="utf8"}
+Remove-Item "*.log"
+
+$env:L_BENCH_TYPE = 'CUVK';
+foreach ($placement in @('DIRECT', 'STAGED')) {
+    $env:L_INPUT_PLACEMENT = $placement;
+    for ($j = 0; $j -lt 10; $j++) {
+        $file = "bench_cuvk.$placement.$j.log";
+        python python/demo.py 2>&1 | %{ "$_" } | Out-File $file -NoNewline;
+    }
+    $cuvk_eval = CollectCuvk($placement)
+    Write-Host "collected data for $placement evaluation inputs: $cuvk_eval"
+}
@@ -1,6 +1,7 @@
 #include "cuvk/context.hpp"
 #include "cuvk/logger.hpp"
 #include <array>
+#include <cstring>
 #include <exception>
 #include <map>
 
@@ -8,6 +9,15 @@ L_CUVK_BEGIN_
 
 constexpr const char* DEBUG_LAYER= "VK_LAYER_LUNARG_standard_validation";
 constexpr const char* DEBUG_EXT = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+constexpr const char* PROPS2_EXT =
+  VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+// Device extensions for importing host allocations.
+constexpr std::array<const char*, 2> EXT_MEM_HOST_EXTS = {
+  VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+  VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,
+};
+// Device extension for querying heap budgets.
+constexpr const char* MEM_BUDGET_EXT = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
 
 static const VkApplicationInfo APP_INFO = {
   VK_STRUCTURE_TYPE_APPLICATION_INFO,
@@ -39,39 +49,74 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL validation_cb(
 }
 
 
+// Check if an extension is in the list of extension properties.
+bool has_ext(const std::vector<VkExtensionProperties>& ext_props,
+  const char* ext) noexcept {
+  for (auto& ext_prop : ext_props) {
+    if (std::strcmp(ext_prop.extensionName, ext) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Vulkan::Vulkan() noexcept :
   inst(VK_NULL_HANDLE),
   phys_dev_infos(),
-  debug_msgr(VK_NULL_HANDLE) {}
-bool Vulkan::make() noexcept {
-  LOG.info("creating vulkan instance");
+  debug_msgr(VK_NULL_HANDLE),
+  has_props2(false) {}
+bool Vulkan::make_inst(bool debug) noexcept {
+  std::vector<const char*> exts;
+  if (debug) {
+    exts.push_back(DEBUG_EXT);
+  }
+  // Properties of extensions are queried by
+  // `VK_KHR_get_physical_device_properties2` in Vulkan 1.0.
+  uint32_t count = 0;
+  std::vector<VkExtensionProperties> ext_props;
+  if (L_VK <- vkEnumerateInstanceExtensionProperties(
+    nullptr, &count, nullptr)) {
+    LOG.error("unable to enumerate instance extensions");
+    return false;
+  }
+  ext_props.resize(count);
+  if (L_VK <- vkEnumerateInstanceExtensionProperties(
+    nullptr, &count, ext_props.data())) {
+    LOG.error("unable to enumerate instance extensions");
+    return false;
+  }
+  has_props2 = has_ext(ext_props, PROPS2_EXT);
+  if (has_props2) {
+    exts.push_back(PROPS2_EXT);
+  }
 
   VkInstanceCreateInfo ici{};
   ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   ici.pApplicationInfo = &APP_INFO;
+  if (debug) {
+    ici.enabledLayerCount = 1;
+    ici.ppEnabledLayerNames = &DEBUG_LAYER;
+  }
+  ici.enabledExtensionCount = static_cast<uint32_t>(exts.size());
+  ici.ppEnabledExtensionNames = exts.data();
 
   if (L_VK <- vkCreateInstance(&ici, nullptr, &inst)) {
-    LOG.error("unable to create vulkan instance in debug mode");
+    LOG.error(debug ?
+      "unable to create vulkan instance in debug mode" :
+      "unable to create vulkan instance");
     return false;
   }
+  return true;
+}
+bool Vulkan::make() noexcept {
+  LOG.info("creating vulkan instance");
+  if (!make_inst(false)) { return false; }
   if (!enum_phys_dev()) { return false; }
   return true;
 }
 bool Vulkan::make_debug() noexcept {
   LOG.info("creating vulkan instance in debug mode");
-
-  VkInstanceCreateInfo ici{};
-  ici.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-  ici.pApplicationInfo = &APP_INFO;
-  ici.enabledLayerCount = 1;
-  ici.ppEnabledLayerNames = &DEBUG_LAYER;
-  ici.enabledExtensionCount = 1;
-  ici.ppEnabledExtensionNames = &DEBUG_EXT;
-
-  if (L_VK <- vkCreateInstance(&ici, nullptr, &inst)) {
-    LOG.error("unable to create vulkan instance");
-    return {};
-  }
+  if (!make_inst(true)) { return false; }
   
   auto func = (PFN_vkCreateDebugUtilsMessengerEXT)
     vkGetInstanceProcAddr(inst, "vkCreateDebugUtilsMessengerEXT");
@@ -160,8 +205,49 @@ bool Vulkan::enum_phys_dev() noexcept {
     qfps.resize(count);
     vkGetPhysicalDeviceQueueFamilyProperties(phys_dev, &count, qfps.data());
 
+    count = 0;
+    std::vector<VkExtensionProperties> ext_props;
+    if (L_VK <- vkEnumerateDeviceExtensionProperties(
+      phys_dev, nullptr, &count, nullptr)) {
+      LOG.error("unable to enumerate device extensions");
+      return false;
+    }
+    ext_props.resize(count);
+    if (L_VK <- vkEnumerateDeviceExtensionProperties(
+      phys_dev, nullptr, &count, ext_props.data())) {
+      LOG.error("unable to enumerate device extensions");
+      return false;
+    }
+    auto get_props2 = has_props2 ?
+      (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(
+        inst, "vkGetPhysicalDeviceProperties2KHR") :
+      nullptr;
+    auto has_ext_mem_host = get_props2 != nullptr &&
+      has_ext(ext_props, EXT_MEM_HOST_EXTS[0]) &&
+      has_ext(ext_props, EXT_MEM_HOST_EXTS[1]);
+    VkDeviceSize min_imported_host_ptr_align = 0;
+    if (has_ext_mem_host) {
+      VkPhysicalDeviceExternalMemoryHostPropertiesEXT pdemhp {};
+      pdemhp.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+      VkPhysicalDeviceProperties2KHR pdp2 {};
+      pdp2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+      pdp2.pNext = &pdemhp;
+      get_props2(phys_dev, &pdp2);
+      min_imported_host_ptr_align = pdemhp.minImportedHostPointerAlignment;
+    }
+    auto has_mem_budget = has_props2 && has_ext(ext_props, MEM_BUDGET_EXT);
+    auto get_mem_props2 = has_mem_budget ?
+      (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(
+        inst, "vkGetPhysicalDeviceMemoryProperties2KHR") :
+      nullptr;
+    has_mem_budget = get_mem_props2 != nullptr;
+
     phys_dev_infos.emplace_back(PhysicalDeviceInfo {
-      phys_dev, props, std::move(qfps) });
+      phys_dev, props, std::move(qfps),
+      has_ext_mem_host, min_imported_host_ptr_align,
+      has_mem_budget, get_mem_props2,
+    });
   }
   LOG.info("found {} physical devices, {} are filtered out", count, filtered);
   return true;
@@ -171,7 +257,8 @@ Context::Context(
   const PhysicalDeviceInfo& phys_dev_info, 
   L_STATIC const VkPhysicalDeviceFeatures& phys_dev_feats,
   L_STATIC Span<VkQueueFlags> queue_caps) noexcept :
-  req({ &phys_dev_info, phys_dev_feats, queue_caps }) {
+  req({ &phys_dev_info, phys_dev_feats, queue_caps }),
+  get_mem_host_ptr_props(nullptr) {
   if (queue_caps.size() > MAX_DEV_QUEUE_COUNT) {
     LOG.error("too many queues to be created");
     std::terminate();
@@ -215,11 +302,24 @@ bool Context::make() noexcept {
   dci.pEnabledFeatures = &req.phys_dev_feats;
   dci.queueCreateInfoCount = ndqci;
   dci.pQueueCreateInfos = dqcis.data();
+  std::vector<const char*> exts;
+  if (phys_dev_info->has_ext_mem_host) {
+    exts.insert(exts.end(), EXT_MEM_HOST_EXTS.begin(), EXT_MEM_HOST_EXTS.end());
+  }
+  if (phys_dev_info->has_mem_budget) {
+    exts.push_back(MEM_BUDGET_EXT);
+  }
+  dci.enabledExtensionCount = static_cast<uint32_t>(exts.size());
+  dci.ppEnabledExtensionNames = exts.data();
 
   if (L_VK <- vkCreateDevice(phys_dev, &dci, nullptr, &dev)) {
     LOG.error("unable to create device");
     return false;
   }
+  if (phys_dev_info->has_ext_mem_host) {
+    get_mem_host_ptr_props = (PFN_vkGetMemoryHostPointerPropertiesEXT)
+      vkGetDeviceProcAddr(dev, "vkGetMemoryHostPointerPropertiesEXT");
+  }
 
   // Collect queues.
   for (uint32_t i = 0; i < ndqci; ++i) {
@@ -242,6 +342,8 @@ Context::~Context() noexcept { drop(); }
 Context::Context(Context&& right) noexcept :
   req(right.req),
   dev(std::exchange(right.dev, nullptr)),
-  queues(std::exchange(right.queues, {})) {}
+  queues(std::exchange(right.queues, {})),
+  get_mem_host_ptr_props(
+    std::exchange(right.get_mem_host_ptr_props, nullptr)) {}
 
 L_CUVK_END_
@@ -6,7 +6,13 @@
 #include "cuvk/executor.hpp"
 #include "cuvk/logger.hpp"
 #include "cuvk/shader_interface.hpp"
+#include "cuvk/transfer.hpp"
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <mutex>
 #include <fstream>
 #include <future>
@@ -24,6 +30,7 @@ const std::array<VkQueueFlags, 1> CUVK_QUEUE_CAPS = {
 constexpr VkPhysicalDeviceFeatures cuvk_phys_dev_feat() {
   VkPhysicalDeviceFeatures feat {};
   feat.geometryShader = true;
+  feat.fragmentStoresAndAtomics = true;
   feat.shaderStorageBufferArrayDynamicIndexing = true;
   feat.shaderStorageImageArrayDynamicIndexing = true;
   return feat;
@@ -54,6 +61,94 @@ constexpr T next_pow_2(T a) {
 
 
 
+// Format of the images simulated universes are drawn to.
+VkFormat get_sim_univ_img_fmt(const CuvkMemoryRequirements& mem_req) {
+  return mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_FLOAT32 ?
+    VK_FORMAT_R32_SFLOAT : VK_FORMAT_R8_UNORM;
+}
+// Size of a texel of the images simulated universes are drawn to, in bytes.
+VkDeviceSize get_sim_univ_texel_size(const CuvkMemoryRequirements& mem_req) {
+  return mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_FLOAT32 ?
+    sizeof(float) : sizeof(uint8_t);
+}
+// Number of 32-bit words in a bitmask of a universe.
+uint32_t get_univ_nword(const CuvkMemoryRequirements& mem_req) {
+  return (mem_req.width * mem_req.height + 31) / 32;
+}
+// Number of pixels along each side of a coarse pixel.
+uint32_t get_coarse_scale(const CuvkMemoryRequirements& mem_req) {
+  return 1u << mem_req.coarseLevel;
+}
+// Size of level `level` of the real universe pyramid. Partially covered coarse
+// pixels are kept.
+VkExtent2D get_level_extent(const CuvkMemoryRequirements& mem_req,
+  uint32_t level) {
+  auto scale = 1u << level;
+  return {
+    (mem_req.width + scale - 1) / scale,
+    (mem_req.height + scale - 1) / scale,
+  };
+}
+// Size of coarse universes.
+VkExtent2D get_coarse_extent(const CuvkMemoryRequirements& mem_req) {
+  return get_level_extent(mem_req, mem_req.coarseLevel);
+}
+// Offset of level `level` in the real universe pyramid, in floats. Levels 1 to
+// `coarseLevel` are placed from the coarsest, so that coarse evaluation reads
+// from the beginning of the pyramid. The offset of level 0 is the size of the
+// pyramid.
+uint32_t get_level_offset(const CuvkMemoryRequirements& mem_req,
+  uint32_t level) {
+  uint32_t rv = 0;
+  for (auto i = mem_req.coarseLevel; i > level; --i) {
+    auto extent = get_level_extent(mem_req, i);
+    rv += extent.width * extent.height;
+  }
+  return rv;
+}
+// IoU and Dice are not sums over pixels; intersections and unions are summed
+// instead.
+bool is_overlap_metric(const CuvkMemoryRequirements& mem_req) {
+  return mem_req.costMetric == CUVK_COST_METRIC_IOU ||
+    mem_req.costMetric == CUVK_COST_METRIC_DICE;
+}
+// Cost of a pixel in per-pixel metrics. Must be consistent with `pixel_cost` in
+// `delta.comp`.
+float get_pixel_cost(const CuvkMemoryRequirements& mem_req, float real,
+  float sim) {
+  auto diff = std::abs(real - sim);
+  switch (mem_req.costMetric) {
+  case CUVK_COST_METRIC_L2:
+    return diff * diff;
+  case CUVK_COST_METRIC_TRUNCATED_L1:
+    return std::min(diff, mem_req.truncation);
+  default:
+    return diff;
+  }
+}
+// Specialization constants are given in 32-bit words, so floats are given in
+// their bits.
+uint32_t get_float_bits(float x) {
+  uint32_t rv;
+  std::memcpy(&rv, &x, sizeof(rv));
+  return rv;
+}
+// Size of a simulated universe in the output format, in bytes.
+VkDeviceSize get_sim_univ_size(const CuvkMemoryRequirements& mem_req) {
+  VkDeviceSize npx = mem_req.width * mem_req.height;
+  switch (mem_req.simUnivFormat) {
+  case CUVK_SIM_UNIV_FORMAT_FLOAT32:
+    return npx * sizeof(float);
+  case CUVK_SIM_UNIV_FORMAT_UNORM8:
+    return npx * sizeof(uint8_t);
+  case CUVK_SIM_UNIV_FORMAT_BIT:
+    return (npx + 31) / 32 * sizeof(uint32_t);
+  }
+  return 0;
+}
+
+
+
 std::vector<uint32_t> read_spirv(const std::string& path) {
   std::ifstream f("assets/shaders/" + path + ".spv",
     std::ios::in | std::ios::binary | std::ios::ate);
@@ -155,7 +250,7 @@ struct CuvkEvalPipeline {
     viewport({ mem_req.width, mem_req.height }),
     attach_descs({
       VkAttachmentDescription {
-        0, VK_FORMAT_R32_SFLOAT, VK_SAMPLE_COUNT_1_BIT,
+        0, get_sim_univ_img_fmt(mem_req), VK_SAMPLE_COUNT_1_BIT,
         VK_ATTACHMENT_LOAD_OP_CLEAR,
         VK_ATTACHMENT_STORE_OP_STORE,
         VK_ATTACHMENT_LOAD_OP_DONT_CARE,
@@ -182,7 +277,89 @@ struct CuvkEvalPipeline {
         vert_binds, vert_attrs, viewport, attach_descs, attach_refs, blends
       })) {}
 };
+// The descriptor set layout is shared by all compute pipelines in evaluation,
+// so that a task only need a single descriptor set. The coverage pipeline
+// shares it too, so the bindings it uses are also visible to the fragment
+// stage. Devices are checked against its descriptor counts on context creation.
+const std::array<VkDescriptorSetLayoutBinding, 21> EVAL_DESC_LAYOUT_BINDS = {
+  VkDescriptorSetLayoutBinding
+  // uint[] real_univ
+  { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    nullptr },
+  // uint[] sim_univs
+  { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+  // float[] costs
+  { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // sampler2DArray sim_univs
+  { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // sampler2DArray base_univ
+  { 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // uvec4[] dirty_rects
+  { 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // uint[] cover_mask
+  { 7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+  // int[] cover_costs
+  { 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+  // Bacterium[] bacs
+  { 9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // Bacterium[] sorted_bacs
+  { 10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // uint[] univ_counts
+  { 11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // uint[] univ_offsets
+  { 12, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // DrawCommand[] draw_cmds
+  { 13, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // uint[] univ_frames
+  { 14, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+    nullptr},
+  // float[] coarse_real_univ
+  { 15, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // sampler2DArray coarse_univs
+  { 16, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // float[] univ_costs
+  { 17, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // TopUniverse[] top_univs
+  { 18, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // uint[] univ_running
+  { 19, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // float[] partial_unions
+  { 20, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+  // float[] weights
+  { 21, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
+};
 struct CuvkCostPipeline {
+  // Push constants of `cost.comp`, the largest among evaluation compute
+  // pipelines.
+  struct CostMeta {
+    uint32_t nsec_univ;
+    uint32_t npack_sec;
+    uint32_t npack_univ;
+    uint32_t sec_offset;
+    float threshold;
+  };
+
   const Shader& comp;
 
   struct Scheduling {
@@ -199,8 +376,13 @@ struct CuvkCostPipeline {
 
     Scheduling(const CuvkMemoryRequirements& mem_req,
       const VkPhysicalDeviceLimits& limits) {
-      // Number of packs in a universe. A pack means 4 touching pixels in a row.
-      npack_univ = mem_req.width * mem_req.height / 4;
+      // Number of packs in a universe. A pack means 4 touching pixels in a row,
+      // or 32 if universes are bit-packed.
+      if (mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT) {
+        npack_univ = (mem_req.width * mem_req.height + 31) / 32;
+      } else {
+        npack_univ = mem_req.width * mem_req.height / 4;
+      }
       // Number of packs in each section.
       // The Vulkan specification didn't claim that the limit
       // `maxComputeWorkGroupSize[0]` must be less than or equal to
@@ -222,7 +404,8 @@ struct CuvkCostPipeline {
   } scheduling;
 
   std::array<ShaderStage, 1> stages;
-  std::array<VkDescriptorSetLayoutBinding, 4> desc_layout_binds;
+  // See `EVAL_DESC_LAYOUT_BINDS`.
+  std::array<VkDescriptorSetLayoutBinding, 21> desc_layout_binds;
   std::array<VkPushConstantRange, 1> push_const_rngs;
 
   const ComputePipeline& pipe_sec;
@@ -238,34 +421,262 @@ struct CuvkCostPipeline {
     stages({
       comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
     }),
-    desc_layout_binds({
-      VkDescriptorSetLayoutBinding
-      // image2D real_univ
-      { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
-      // image2DArray sim_univs
-      { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
-      // float[] temp
-      { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
-      // float[] costs
-      { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-        1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr},
-    }),
+    desc_layout_binds(EVAL_DESC_LAYOUT_BINDS),
     push_const_rngs({
       VkPushConstantRange
-      { VK_SHADER_STAGE_COMPUTE_BIT, 0, 16 },
+      { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CostMeta) },
     }),
     pipe_sec(pipe_mgr.declare_comp_pipe("cost_sec",
-      PipelineRequirements { stages, push_const_rngs, desc_layout_binds },
-      ComputePipelineRequirements {
-        std::array<uint32_t, 3> { scheduling.npack_sec, 1, 1 }
-      })),
+      eval_pipe_req(stages),
+      sec_comp_req(get_spec_consts(mem_req)))),
     pipe_res(pipe_mgr.declare_comp_pipe("cost_res",
-      PipelineRequirements { stages, push_const_rngs, desc_layout_binds },
+      eval_pipe_req(stages),
       ComputePipelineRequirements {
-        std::array<uint32_t, 3> { scheduling.npack_res, 1, 1 }
+        std::array<uint32_t, 3> { scheduling.npack_res, 1, 1 },
+        get_spec_consts(mem_req),
+      })) {}
+
+  static std::vector<std::pair<uint32_t, uint32_t>> get_spec_consts(
+    const CuvkMemoryRequirements& mem_req) {
+    return {
+      { 4, (uint32_t)mem_req.simUnivFormat },
+      { 5, mem_req.width },
+      { 6, mem_req.height },
+      { 7, (uint32_t)mem_req.costMetric },
+      { 8, get_float_bits(mem_req.truncation) },
+      { 9, mem_req.useWeightMap ? 1u : 0u },
+    };
+  }
+  // Requirements of the evaluation compute pipelines, which share the layout
+  // of the cost pipelines.
+  PipelineRequirements eval_pipe_req(Span<ShaderStage> stages) const {
+    return PipelineRequirements { stages, push_const_rngs, desc_layout_binds };
+  }
+  // Requirements of compute pipelines dispatched in workgroups of a section,
+  // with extra specialization constants `spec_consts`.
+  ComputePipelineRequirements sec_comp_req(
+    std::vector<std::pair<uint32_t, uint32_t>> spec_consts) const {
+    return ComputePipelineRequirements {
+      std::array<uint32_t, 3> { scheduling.npack_sec, 1, 1 },
+      std::move(spec_consts),
+    };
+  }
+};
+struct CuvkDeltaPipeline {
+  const Shader& comp;
+
+  std::array<ShaderStage, 1> stages;
+
+  const ComputePipeline& pipe;
+
+  CuvkDeltaPipeline(const CuvkMemoryRequirements& mem_req,
+    const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    comp(shader_mgr.declare_shader(read_spirv("delta.comp"))),
+    stages({
+      comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    pipe(pipe_mgr.declare_comp_pipe("delta",
+      cost_pipe.eval_pipe_req(stages),
+      cost_pipe.sec_comp_req({
+        { 4, (uint32_t)mem_req.simUnivFormat },
+        { 7, (uint32_t)mem_req.costMetric },
+        { 8, get_float_bits(mem_req.truncation) },
+        { 9, mem_req.useWeightMap ? 1u : 0u },
+      }))) {}
+};
+// Pack rendered universes into bits. Only used when universes are bit-packed.
+struct CuvkPackPipeline {
+  const Shader& comp;
+
+  std::array<ShaderStage, 1> stages;
+
+  const ComputePipeline& pipe;
+
+  CuvkPackPipeline(const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    comp(shader_mgr.declare_shader(read_spirv("pack.comp"))),
+    stages({
+      comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    pipe(pipe_mgr.declare_comp_pipe("pack",
+      cost_pipe.eval_pipe_req(stages),
+      cost_pipe.sec_comp_req({}))) {}
+};
+
+// Sort bacteria by universe with counting sort, and make indirect draw commands
+// for each framebuffer.
+struct CuvkBucketPipeline {
+  const Shader& count_comp;
+  const Shader& scan_comp;
+  const Shader& scatter_comp;
+
+  std::array<ShaderStage, 1> count_stages;
+  std::array<ShaderStage, 1> scan_stages;
+  std::array<ShaderStage, 1> scatter_stages;
+
+  const ComputePipeline& count_pipe;
+  const ComputePipeline& scan_pipe;
+  const ComputePipeline& scatter_pipe;
+
+  CuvkBucketPipeline(const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    count_comp(shader_mgr.declare_shader(read_spirv("bucket_count.comp"))),
+    scan_comp(shader_mgr.declare_shader(read_spirv("bucket_scan.comp"))),
+    scatter_comp(shader_mgr.declare_shader(read_spirv("bucket_scatter.comp"))),
+    count_stages({
+      count_comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    scan_stages({
+      scan_comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    scatter_stages({
+      scatter_comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    count_pipe(pipe_mgr.declare_comp_pipe("bucket_count",
+      cost_pipe.eval_pipe_req(count_stages),
+      cost_pipe.sec_comp_req({}))),
+    scan_pipe(pipe_mgr.declare_comp_pipe("bucket_scan",
+      cost_pipe.eval_pipe_req(scan_stages),
+      cost_pipe.sec_comp_req({}))),
+    scatter_pipe(pipe_mgr.declare_comp_pipe("bucket_scatter",
+      cost_pipe.eval_pipe_req(scatter_stages),
+      cost_pipe.sec_comp_req({}))) {}
+};
+// Build the real universe pyramid, cost universes drawn at a reduced
+// resolution, and renumber the bacteria of the universes to be refined in
+// coarse-to-fine evaluation. There is a downsampling variant for each pyramid
+// level up to the one requested at context creation. Coarse universes are drawn
+// by the evaluation pipeline.
+struct CuvkCoarsePipeline {
+  const Shader& downsample_comp;
+  const Shader& cost_comp;
+  const Shader& compact_comp;
+
+  std::array<ShaderStage, 1> downsample_stages;
+  std::array<ShaderStage, 1> cost_stages;
+  std::array<ShaderStage, 1> compact_stages;
+
+  // Variants of levels 1 to `coarseLevel`.
+  std::vector<const ComputePipeline*> downsample_pipes;
+  const ComputePipeline& pipe;
+  const ComputePipeline& compact_pipe;
+
+  CuvkCoarsePipeline(const CuvkMemoryRequirements& mem_req,
+    const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    downsample_comp(shader_mgr.declare_shader(read_spirv("downsample.comp"))),
+    cost_comp(shader_mgr.declare_shader(read_spirv("coarse.comp"))),
+    compact_comp(shader_mgr.declare_shader(read_spirv("compact.comp"))),
+    downsample_stages({
+      downsample_comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    cost_stages({
+      cost_comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    compact_stages({
+      compact_comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    downsample_pipes(),
+    pipe(pipe_mgr.declare_comp_pipe("coarse",
+      cost_pipe.eval_pipe_req(cost_stages),
+      cost_pipe.sec_comp_req({
+        { 5, get_coarse_extent(mem_req).width },
+        { 6, get_coarse_extent(mem_req).height },
+        { 7, (uint32_t)mem_req.costMetric },
+        { 8, get_float_bits(mem_req.truncation) },
+      }))),
+    compact_pipe(pipe_mgr.declare_comp_pipe("compact",
+      cost_pipe.eval_pipe_req(compact_stages),
+      cost_pipe.sec_comp_req({}))) {
+    for (auto level = 1u; level <= mem_req.coarseLevel; ++level) {
+      downsample_pipes.push_back(&pipe_mgr.declare_comp_pipe("downsample",
+        cost_pipe.eval_pipe_req(downsample_stages),
+        cost_pipe.sec_comp_req({
+          { 4, (uint32_t)mem_req.simUnivFormat },
+          { 5, mem_req.width },
+          { 6, mem_req.height },
+          { 7, 1u << level },
+          { 8, get_level_offset(mem_req, level - 1) },
+          { 9, get_level_offset(mem_req, level) },
+        })));
+    }
+  }
+};
+// Sum up the partial costs of each universe on device, so that only a cost per
+// universe is read back.
+struct CuvkReducePipeline {
+  const Shader& comp;
+
+  std::array<ShaderStage, 1> stages;
+
+  const ComputePipeline& pipe;
+
+  CuvkReducePipeline(const CuvkMemoryRequirements& mem_req,
+    const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    comp(shader_mgr.declare_shader(read_spirv("reduce.comp"))),
+    stages({
+      comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    pipe(pipe_mgr.declare_comp_pipe("reduce",
+      cost_pipe.eval_pipe_req(stages),
+      cost_pipe.sec_comp_req({ { 7, (uint32_t)mem_req.costMetric } }))) {}
+};
+// Select the universes of the lowest costs on device, so that only the selected
+// ones are read back. The refinement variant selects the universes to be
+// refined in coarse-to-fine evaluation.
+struct CuvkTopKPipeline {
+  const Shader& comp;
+
+  std::array<ShaderStage, 1> stages;
+
+  const ComputePipeline& pipe;
+  const ComputePipeline& refine_pipe;
+
+  CuvkTopKPipeline(const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    comp(shader_mgr.declare_shader(read_spirv("topk.comp"))),
+    stages({
+      comp.stage("main", VK_SHADER_STAGE_COMPUTE_BIT),
+    }),
+    pipe(pipe_mgr.declare_comp_pipe("topk",
+      cost_pipe.eval_pipe_req(stages),
+      cost_pipe.sec_comp_req({}))),
+    refine_pipe(pipe_mgr.declare_comp_pipe("refine",
+      cost_pipe.eval_pipe_req(stages),
+      cost_pipe.sec_comp_req({ { 4, 1 } }))) {}
+};
+// Draw simulated universes and accumulate their costs in the fragment stage.
+// Shares everything but the fragment shader with the evaluation pipeline.
+struct CuvkCoverPipeline {
+  const Shader& frag;
+
+  std::array<ShaderStage, 3> stages;
+  std::array<VkPushConstantRange, 1> push_const_rngs;
+
+  const GraphicsPipeline& pipe;
+
+  CuvkCoverPipeline(const CuvkEvalPipeline& eval_pipe,
+    const CuvkCostPipeline& cost_pipe,
+    ShaderManager& shader_mgr, PipelineManager& pipe_mgr) :
+    frag(shader_mgr.declare_shader(read_spirv("cover.frag"))),
+    stages({
+      eval_pipe.vert.stage("main", VK_SHADER_STAGE_VERTEX_BIT),
+      eval_pipe.geom.stage("main", VK_SHADER_STAGE_GEOMETRY_BIT),
+      frag.stage("main", VK_SHADER_STAGE_FRAGMENT_BIT),
+    }),
+    push_const_rngs({
+      VkPushConstantRange
+      { VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, 24 },
+    }),
+    pipe(pipe_mgr.declare_graph_pipe("cover",
+      PipelineRequirements {
+        stages, push_const_rngs, cost_pipe.desc_layout_binds
+      },
+      GraphicsPipelineRequirements {
+        eval_pipe.vert_binds, eval_pipe.vert_attrs, eval_pipe.viewport,
+        eval_pipe.attach_descs, eval_pipe.attach_refs, eval_pipe.blends
       })) {}
 };
 
@@ -276,6 +687,15 @@ struct CuvkPipelines {
   CuvkDeformPipeline deform_pipe;
   CuvkEvalPipeline eval_pipe;
   CuvkCostPipeline cost_pipe;
+  CuvkDeltaPipeline delta_pipe;
+  CuvkPackPipeline pack_pipe;
+  CuvkCoverPipeline cover_pipe;
+  CuvkBucketPipeline bucket_pipe;
+  CuvkCoarsePipeline coarse_pipe;
+  CuvkReducePipeline reduce_pipe;
+  CuvkTopKPipeline topk_pipe;
+
+  Sampler sampler;
 
   CuvkPipelines(const Context& ctxt, const CuvkMemoryRequirements& mem_req) :
     shader_mgr(ctxt),
@@ -283,12 +703,21 @@ struct CuvkPipelines {
 
     deform_pipe(mem_req, shader_mgr, pipe_mgr),
     eval_pipe(mem_req, shader_mgr, pipe_mgr),
-    cost_pipe(mem_req, shader_mgr, pipe_mgr) {
+    cost_pipe(mem_req, shader_mgr, pipe_mgr),
+    delta_pipe(mem_req, cost_pipe, shader_mgr, pipe_mgr),
+    pack_pipe(cost_pipe, shader_mgr, pipe_mgr),
+    cover_pipe(eval_pipe, cost_pipe, shader_mgr, pipe_mgr),
+    bucket_pipe(cost_pipe, shader_mgr, pipe_mgr),
+    coarse_pipe(mem_req, cost_pipe, shader_mgr, pipe_mgr),
+    reduce_pipe(mem_req, cost_pipe, shader_mgr, pipe_mgr),
+    topk_pipe(cost_pipe, shader_mgr, pipe_mgr),
+    sampler(ctxt) {
   }
   bool make() {
-    return shader_mgr.make(false) && pipe_mgr.make();
+    return shader_mgr.make(false) && pipe_mgr.make() && sampler.make();
   }
   void drop() {
+    sampler.drop();
     pipe_mgr.drop();
     shader_mgr.drop();
   }
@@ -303,6 +732,100 @@ struct CuvkPipelines {
 //
 
 
+// Whether the device reads host-visible memory as fast as its own memory. It's
+// true if the device shares memory with the host, or if all of the device-local
+// memory is host-visible (e.g. resizable BAR).
+bool is_host_visible_mem_local(const PhysicalDeviceInfo& phys_dev_info) {
+  if (phys_dev_info.phys_dev_props.deviceType ==
+    VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+    phys_dev_info.phys_dev_props.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+    return true;
+  }
+  VkPhysicalDeviceMemoryProperties pdmp;
+  vkGetPhysicalDeviceMemoryProperties(phys_dev_info.phys_dev, &pdmp);
+  VkDeviceSize max_local_heap_size = 0;
+  for (auto i = 0u; i < pdmp.memoryHeapCount; ++i) {
+    auto& heap = pdmp.memoryHeaps[i];
+    if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      max_local_heap_size = std::max(max_local_heap_size, heap.size);
+    }
+  }
+  const VkMemoryPropertyFlags local_visible =
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  for (auto i = 0u; i < pdmp.memoryTypeCount; ++i) {
+    auto& mem_type = pdmp.memoryTypes[i];
+    if ((mem_type.propertyFlags & local_visible) == local_visible &&
+      pdmp.memoryHeaps[mem_type.heapIndex].size == max_local_heap_size) {
+      return true;
+    }
+  }
+  return false;
+}
+// Whether evaluation inputs are copied to device-local memory before use.
+bool is_input_staged(const PhysicalDeviceInfo& phys_dev_info,
+  const CuvkMemoryRequirements& mem_req) {
+  switch (mem_req.inputPlacement) {
+  case CUVK_INPUT_PLACEMENT_DIRECT:
+    return false;
+  case CUVK_INPUT_PLACEMENT_STAGED:
+    return true;
+  default:
+    return !is_host_visible_mem_local(phys_dev_info);
+  }
+}
+// Number of input slots of evaluation bacteria. Bacteria of the next chunk of a
+// split evaluation are uploaded to another slot while the device is working on
+// the current chunk.
+const uint32_t NBAC_SLOT = 2;
+// Usages of the host-visible and device-only buffers, including those grown
+// with invocations.
+const VkBufferUsageFlags HV_BUF_USAGE =
+  VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+  VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+const VkBufferUsageFlags DO_BUF_USAGE =
+  VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+  VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+// Number of bacteria an evaluation batch can hold at most. Bacteria are bound
+// as a whole, and are bucketed by a workgroup for each section of them.
+uint32_t get_max_eval_nbac(const VkPhysicalDeviceLimits& limits,
+  const CuvkMemoryRequirements& mem_req) {
+  CuvkCostPipeline::Scheduling cost_sch(mem_req, limits);
+  return (uint32_t)std::min<uint64_t>(
+    limits.maxStorageBufferRange / sizeof(Bacterium),
+    (uint64_t)limits.maxComputeWorkGroupCount[0] * cost_sch.npack_sec);
+}
+// Sizes of the evaluation buffers grown with invocations, when they hold `nbac`
+// bacteria and `nuniv` universes.
+struct EvaluationBufferSizes {
+  // Input slots of bacteria are placed one after another, each of them aligned
+  // to be bound alone. Staged copies are laid out in the same way.
+  VkDeviceSize bacs_stride;
+  VkDeviceSize bacs;
+  VkDeviceSize sorted_bacs;
+  VkDeviceSize sim_univs;
+  VkDeviceSize partial_costs;
+  VkDeviceSize univ_costs;
+  VkDeviceSize top_univs;
+
+  EvaluationBufferSizes(const VkPhysicalDeviceLimits& limits,
+    const CuvkMemoryRequirements& mem_req, uint32_t nbac, uint32_t nuniv) {
+    CuvkCostPipeline::Scheduling cost_sch(mem_req, limits);
+    bacs_stride = detail::align<VkDeviceSize>(nbac * sizeof(Bacterium),
+      limits.minStorageBufferOffsetAlignment);
+    bacs = NBAC_SLOT * bacs_stride;
+    sorted_bacs = nbac * sizeof(Bacterium);
+    sim_univs = nuniv * get_sim_univ_size(mem_req);
+    partial_costs = nuniv * cost_sch.nsec_actual * sizeof(float);
+    univ_costs = nuniv * sizeof(float);
+    top_univs = nuniv * sizeof(TopUniverse);
+  }
+};
+
 struct MemoryAllocationGuidelines {
   BufferSizer hv_buf_sizer;
   BufferSizer do_buf_sizer;
@@ -313,40 +836,113 @@ struct MemoryAllocationGuidelines {
     RawBufferSlice bacs_out;
   } deformation;
   struct {
-    RawBufferSlice bacs;
     RawBufferSlice real_univ;
+    bool is_input_staged;
+    RawBufferSlice staged_real_univ;
     RawImageSlice sim_univs_temps;
-    RawBufferSlice sum_temp;
-    RawBufferSlice sim_univs;
-    RawBufferSlice partial_costs;
+    RawBufferSlice dirty_rects;
+    RawBufferSlice cover_mask;
+    RawBufferSlice cover_costs;
+    RawBufferSlice univ_counts;
+    RawBufferSlice univ_offsets;
+    RawBufferSlice draw_cmds;
+    RawBufferSlice univ_frames;
+    RawBufferSlice real_univs;
+    VkDeviceSize real_univ_stride;
+    RawBufferSlice coarse_real_univ;
+    RawBufferSlice coarse_real_univs;
+    VkDeviceSize coarse_real_univ_stride;
+    RawBufferSlice univ_running;
+    RawBufferSlice partial_unions;
+    RawBufferSlice weights;
   } evaluation;
 
-  MemoryAllocationGuidelines(const Context& ctxt, const CuvkPipelines& pipes,
+  MemoryAllocationGuidelines(const PhysicalDeviceInfo& phys_dev_info,
     const CuvkMemoryRequirements& mem_req) {
-    auto& limits = ctxt.req.phys_dev_info->phys_dev_props.limits;
+    auto& limits = phys_dev_info.phys_dev_props.limits;
     auto storage_buf_alignment = limits.minStorageBufferOffsetAlignment;
-    deformation.deform_specs = hv_buf_sizer.allocate<DeformSpecs>(
-      mem_req.nspec, storage_buf_alignment);
-    deformation.bacs = hv_buf_sizer.allocate<Bacterium>(
-      mem_req.nbac, storage_buf_alignment);
-    deformation.bacs_out = hv_buf_sizer.allocate<Bacterium>(
-      mem_req.nspec * mem_req.nbac, storage_buf_alignment);
+    // Bacteria, rendered universes and costs are not sized here; they are
+    // grown with invocations, see `Cuvk::grow_eval_bufs`. Host-visible memory
+    // sized here is only used within a submission, and submissions are made
+    // one at a time. Deformation memory aliases the evaluation memory
+    // allocated from here.
+    auto hv_transient = hv_buf_sizer.mark();
 
-    auto cost_sch = pipes.cost_pipe.scheduling;
+    CuvkCostPipeline::Scheduling cost_sch(mem_req, limits);
     auto nsec = cost_sch.nsec_actual;
     auto univ_size = mem_req.width * mem_req.height;
+    // Buffers only used by one of the cost modes are given a single element,
+    // as descriptors can't refer to empty ranges.
+    auto is_coverage = mem_req.costMode == CUVK_COST_MODE_COVERAGE;
 
-    evaluation.bacs = hv_buf_sizer.allocate<Bacterium>(
-      mem_req.nspec * mem_req.nbac, storage_buf_alignment);
     evaluation.real_univ = hv_buf_sizer.allocate<float>(
       univ_size, storage_buf_alignment);
+    // Device-local copies of the inputs above are given a single element if
+    // inputs are read directly.
+    evaluation.is_input_staged = is_input_staged(phys_dev_info, mem_req);
+    LOG.info("evaluation inputs are {}",
+      evaluation.is_input_staged ? "staged" : "read directly");
+    evaluation.staged_real_univ = do_buf_sizer.allocate<float>(
+      evaluation.is_input_staged ? univ_size : 1, storage_buf_alignment);
     evaluation.sim_univs_temps = do_img_sizer.allocate(mem_req.nuniv);
-    evaluation.sum_temp = do_buf_sizer.allocate<float>(
-      mem_req.nuniv * univ_size / 4, storage_buf_alignment);
-    evaluation.sim_univs = hv_buf_sizer.allocate<float>(
-      mem_req.nuniv * univ_size, storage_buf_alignment);
-    evaluation.partial_costs = hv_buf_sizer.allocate<float>(
-      mem_req.nuniv * nsec, storage_buf_alignment);
+    evaluation.dirty_rects = hv_buf_sizer.allocate<Rect>(
+      mem_req.nuniv, storage_buf_alignment);
+    evaluation.cover_mask = do_buf_sizer.allocate<uint32_t>(
+      is_coverage ? mem_req.nuniv * get_univ_nword(mem_req) : 1,
+      storage_buf_alignment);
+    evaluation.cover_costs = do_buf_sizer.allocate<int32_t>(
+      is_coverage ? mem_req.nuniv : 1, storage_buf_alignment);
+    // Bacteria are bucketed by universe on device. There is a draw command for
+    // each framebuffer.
+    auto nframebuf = (mem_req.nuniv + limits.maxFramebufferLayers - 1) /
+      limits.maxFramebufferLayers;
+    evaluation.univ_counts = do_buf_sizer.allocate<uint32_t>(
+      mem_req.nuniv, storage_buf_alignment);
+    evaluation.univ_offsets = do_buf_sizer.allocate<uint32_t>(
+      mem_req.nuniv + 1, storage_buf_alignment);
+    evaluation.draw_cmds = do_buf_sizer.allocate<VkDrawIndirectCommand>(
+      nframebuf, storage_buf_alignment);
+    evaluation.univ_frames = hv_buf_sizer.allocate<uint32_t>(
+      mem_req.nuniv, storage_buf_alignment);
+    // Resident real universes are sent through `real_univ` as staging buffer,
+    // so they have the same size. They are placed one after another, so that
+    // each of them can be bound alone, and all of them can be bound at once
+    // for multi-frame evaluation.
+    evaluation.real_univ_stride = detail::align<VkDeviceSize>(
+      univ_size * sizeof(float), storage_buf_alignment);
+    evaluation.real_univs = do_buf_sizer.allocate(
+      std::max(mem_req.nRealUniv, 1u) * evaluation.real_univ_stride,
+      storage_buf_alignment);
+    // Real universe pyramids are kept for the real universe sent along with
+    // evaluations, and for each of the resident ones, in the same way.
+    auto pyramid_size = std::max(get_level_offset(mem_req, 0), 1u);
+    evaluation.coarse_real_univ = do_buf_sizer.allocate<float>(
+      pyramid_size, storage_buf_alignment);
+    evaluation.coarse_real_univ_stride = detail::align<VkDeviceSize>(
+      pyramid_size * sizeof(float), storage_buf_alignment);
+    evaluation.coarse_real_univs = do_buf_sizer.allocate(
+      (mem_req.coarseLevel != 0 ? std::max(mem_req.nRealUniv, 1u) : 1) *
+        evaluation.coarse_real_univ_stride,
+      storage_buf_alignment);
+    evaluation.univ_running = do_buf_sizer.allocate<uint32_t>(
+      mem_req.nuniv, storage_buf_alignment);
+    evaluation.partial_unions = do_buf_sizer.allocate<float>(
+      is_overlap_metric(mem_req) ? mem_req.nuniv * nsec : 1,
+      storage_buf_alignment);
+    // The weight map is sent through `real_univ` as staging buffer too.
+    evaluation.weights = do_buf_sizer.allocate<float>(
+      mem_req.useWeightMap ? univ_size : 1, storage_buf_alignment);
+
+    hv_buf_sizer.rewind(hv_transient);
+    deformation.deform_specs = hv_buf_sizer.allocate<DeformSpecs>(
+      mem_req.nspec, storage_buf_alignment);
+    deformation.bacs = hv_buf_sizer.allocate<Bacterium>(
+      mem_req.nbac, storage_buf_alignment);
+    deformation.bacs_out = hv_buf_sizer.allocate<Bacterium>(
+      mem_req.nspec * mem_req.nbac, storage_buf_alignment);
+
+    LOG.info("host-visible buffer takes {} bytes with aliasing, {} bytes "
+      "without", (VkDeviceSize)hv_buf_sizer, hv_buf_sizer.total());
   }
 };
 
@@ -357,18 +953,103 @@ struct CuvkDeformationAllocations {
   // Direct outputs.
   BufferSlice bacs_out;
 };
+// A buffer allocated from heap arenas after the context is made, which is
+// reallocated to grow. Contents are discarded as it grows.
+struct GrowableBuffer {
+  VkBufferUsageFlags usage;
+  MemoryVisibility visibility;
+  const BufferAllocation* buf_alloc;
+
+  // Reallocate the buffer if it's smaller than `size` bytes. The buffer is left
+  // as it is if a larger one can't be allocated.
+  bool grow(HeapManager& heap_mgr, VkDeviceSize size) {
+    if (buf_alloc != nullptr && buf_alloc->req.size >= size) {
+      return true;
+    }
+    auto new_buf_alloc = heap_mgr.alloc_buf(size, usage, visibility);
+    if (new_buf_alloc == nullptr) {
+      return false;
+    }
+    auto old_buf_alloc = buf_alloc;
+    {
+      // Buffers are inspected by memory statistics queries.
+      std::scoped_lock _(heap_mgr.sync);
+      buf_alloc = new_buf_alloc;
+    }
+    if (old_buf_alloc != nullptr) {
+      heap_mgr.free_buf(*old_buf_alloc);
+    }
+    return true;
+  }
+  BufferSlice slice(VkDeviceSize size) const {
+    return { buf_alloc, 0, size };
+  }
+};
+
 struct CuvkEvaluationAllocations {
   // Direct inputs.
   BufferSlice bacs;
   BufferSlice real_univ;
+  // The direct inputs as the device reads them. They are copies in device-local
+  // memory if inputs are staged, or the direct inputs themselves otherwise.
+  bool is_input_staged;
+  BufferSlice dev_bacs;
+  BufferSlice dev_real_univ;
+  // Input slots of bacteria, in both forms above.
+  std::vector<BufferSlice> bacs_slots;
+  std::vector<BufferSlice> dev_bacs_slots;
   // Intermediate memories.
   std::vector<ImageView> sim_univs_temps;
   std::vector<Framebuffer> sim_univs_temp_framebufs;
   ImageSlice sim_univs_temp_entire;
-  BufferSlice sum_temp;
+  ImageView sim_univs_temp_view;
+  BufferSlice dirty_rects;
+  BufferSlice cover_mask;
+  BufferSlice sorted_bacs;
+  BufferSlice univ_counts;
+  BufferSlice univ_offsets;
+  BufferSlice draw_cmds;
+  BufferSlice univ_frames;
+  // Resident real universes, as a whole and in slots.
+  BufferSlice real_univs;
+  std::vector<BufferSlice> real_univ_slots;
   // Direct outputs.
   BufferSlice sim_univs;
   BufferSlice partial_costs;
+  BufferSlice cover_costs;
+  // Final costs of each universe, and the selected universes of top-K
+  // selection.
+  BufferSlice univ_costs;
+  BufferSlice top_univs;
+  // Resident base universe of incremental evaluation.
+  ImageView base_univ;
+  std::optional<Framebuffer> base_univ_framebuf;
+  // Coarse universes of coarse-to-fine evaluation, and the real universe
+  // pyramids of the real universe sent along and of each of the resident ones.
+  BufferSlice coarse_real_univ;
+  BufferSlice coarse_real_univs;
+  std::vector<BufferSlice> coarse_real_univ_slots;
+  std::vector<ImageView> coarse_univs;
+  std::vector<Framebuffer> coarse_univ_framebufs;
+  ImageView coarse_univ_view;
+  // Running costs of early rejection.
+  BufferSlice univ_running;
+  // Partial areas of unions in IoU and Dice metrics.
+  BufferSlice partial_unions;
+  // Resident weight map.
+  BufferSlice weights;
+  // Buffers of bacteria, rendered universes and costs, which the slices above
+  // are taken from. They are grown with invocations by `Cuvk::grow_eval_bufs`,
+  // up to `nbac_cap` bacteria and `nuniv_cap` universes.
+  GrowableBuffer bacs_buf;
+  GrowableBuffer staged_bacs_buf;
+  GrowableBuffer sorted_bacs_buf;
+  GrowableBuffer sim_univs_buf;
+  GrowableBuffer partial_costs_buf;
+  GrowableBuffer univ_costs_buf;
+  GrowableBuffer top_univs_buf;
+  uint32_t nbac_cap;
+  uint32_t nuniv_cap;
 };
 
 struct CuvkAllocations {
@@ -377,6 +1058,8 @@ struct CuvkAllocations {
   const BufferAllocation& hv_buf;
   const BufferAllocation& do_buf;
   const ImageAllocation& do_img;
+  const ImageAllocation& base_img;
+  const ImageAllocation& coarse_img;
 
   CuvkDeformationAllocations deformation_allocs;
   CuvkEvaluationAllocations evaluation_allocs;
@@ -387,20 +1070,31 @@ struct CuvkAllocations {
     const CuvkMemoryRequirements& mem_req,
     const MemoryAllocationGuidelines& req) :
     heap_mgr(ctxt),
-    hv_buf(heap_mgr.declare_buf(req.hv_buf_sizer,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    hv_buf(heap_mgr.declare_buf(req.hv_buf_sizer, HV_BUF_USAGE,
       MemoryVisibility::HostVisible)),
-    do_buf(heap_mgr.declare_buf(req.do_buf_sizer,
-      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    do_buf(heap_mgr.declare_buf(req.do_buf_sizer, DO_BUF_USAGE,
       MemoryVisibility::DeviceOnly)),
     do_img(heap_mgr.declare_img({ mem_req.width, mem_req.height },
-      req.do_img_sizer, VK_FORMAT_R32_SFLOAT,
+      req.do_img_sizer, get_sim_univ_img_fmt(mem_req),
       VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
       VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-      VK_IMAGE_USAGE_STORAGE_BIT |
+      VK_IMAGE_USAGE_SAMPLED_BIT |
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+      VK_IMAGE_TILING_OPTIMAL,
+      MemoryVisibility::DeviceOnly)),
+    base_img(heap_mgr.declare_img({ mem_req.width, mem_req.height },
+      1, get_sim_univ_img_fmt(mem_req),
+      VK_IMAGE_USAGE_SAMPLED_BIT |
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+      VK_IMAGE_TILING_OPTIMAL,
+      MemoryVisibility::DeviceOnly)),
+    // Coarse universes are only allocated if coarse-to-fine evaluation is
+    // enabled, but the image is always made for descriptors to refer to.
+    coarse_img(heap_mgr.declare_img(get_coarse_extent(mem_req),
+      mem_req.coarseLevel != 0 ? mem_req.nuniv : 1,
+      get_sim_univ_img_fmt(mem_req),
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+      VK_IMAGE_USAGE_SAMPLED_BIT |
       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
       VK_IMAGE_TILING_OPTIMAL,
       MemoryVisibility::DeviceOnly)),
@@ -409,18 +1103,73 @@ struct CuvkAllocations {
       hv_buf.slice(req.deformation.bacs),
       hv_buf.slice(req.deformation.bacs_out),
     }),
+    // Bacteria, rendered universes and costs are taken from the growable
+    // buffers once they are allocated.
     evaluation_allocs({
-      hv_buf.slice(req.evaluation.bacs),
+      {},
       hv_buf.slice(req.evaluation.real_univ),
+      req.evaluation.is_input_staged,
+      {},
+      req.evaluation.is_input_staged ?
+        do_buf.slice(req.evaluation.staged_real_univ) :
+        hv_buf.slice(req.evaluation.real_univ),
+      {},
+      {},
       {},
       {},
       do_img.slice(req.evaluation.sim_univs_temps, true),
-      do_buf.slice(req.evaluation.sum_temp),
-      hv_buf.slice(req.evaluation.sim_univs),
-      hv_buf.slice(req.evaluation.partial_costs),
+      do_img.view(req.evaluation.sim_univs_temps, true),
+      hv_buf.slice(req.evaluation.dirty_rects),
+      do_buf.slice(req.evaluation.cover_mask),
+      {},
+      do_buf.slice(req.evaluation.univ_counts),
+      do_buf.slice(req.evaluation.univ_offsets),
+      do_buf.slice(req.evaluation.draw_cmds),
+      hv_buf.slice(req.evaluation.univ_frames),
+      do_buf.slice(req.evaluation.real_univs),
+      {},
+      {},
+      {},
+      do_buf.slice(req.evaluation.cover_costs),
+      {},
+      {},
+      base_img.view(0, 1),
+      {},
+      do_buf.slice(req.evaluation.coarse_real_univ),
+      do_buf.slice(req.evaluation.coarse_real_univs),
+      {},
+      {},
+      {},
+      coarse_img.view(0, coarse_img.req.nlayer),
+      do_buf.slice(req.evaluation.univ_running),
+      do_buf.slice(req.evaluation.partial_unions),
+      do_buf.slice(req.evaluation.weights),
+      { HV_BUF_USAGE, MemoryVisibility::HostVisible, nullptr },
+      { DO_BUF_USAGE, MemoryVisibility::DeviceOnly, nullptr },
+      { DO_BUF_USAGE, MemoryVisibility::DeviceOnly, nullptr },
+      { HV_BUF_USAGE, MemoryVisibility::HostVisible, nullptr },
+      { HV_BUF_USAGE, MemoryVisibility::HostVisible, nullptr },
+      { HV_BUF_USAGE, MemoryVisibility::HostVisible, nullptr },
+      { HV_BUF_USAGE, MemoryVisibility::HostVisible, nullptr },
+      0,
+      0,
     }),
     framebuf_refs() {
-    
+    auto real_univ_stride = req.evaluation.real_univ_stride;
+    for (auto i = 0u; i < mem_req.nRealUniv; ++i) {
+      evaluation_allocs.real_univ_slots.push_back(
+        evaluation_allocs.real_univs.slice(
+          i * real_univ_stride, real_univ_stride));
+    }
+    if (mem_req.coarseLevel != 0) {
+      auto coarse_stride = req.evaluation.coarse_real_univ_stride;
+      for (auto i = 0u; i < mem_req.nRealUniv; ++i) {
+        evaluation_allocs.coarse_real_univ_slots.push_back(
+          evaluation_allocs.coarse_real_univs.slice(
+            i * coarse_stride, coarse_stride));
+      }
+    }
+
     auto limits = ctxt.req.phys_dev_info->phys_dev_props.limits;
     // Number of framebuffers that use full support (max number of layers).
     auto nfull_framebuf = mem_req.nuniv / limits.maxFramebufferLayers;
@@ -429,9 +1178,13 @@ struct CuvkAllocations {
     // Number of framebuffer to be created.
     auto nframebuf =
       nuniv_last_framebuf == 0 ? nfull_framebuf : nfull_framebuf + 1;
-    // Reserve spaces for framebuffers
+    // Reserve spaces for framebuffers. Framebuffers refer to the elements of
+    // `framebuf_refs` so it must not be reallocated.
     evaluation_allocs.sim_univs_temps.reserve(nframebuf);
     evaluation_allocs.sim_univs_temp_framebufs.reserve(nframebuf);
+    evaluation_allocs.coarse_univs.reserve(nframebuf);
+    evaluation_allocs.coarse_univ_framebufs.reserve(nframebuf);
+    framebuf_refs.reserve(2 * nframebuf + 1);
 
     // Create image views and framebuffers for each universe that has full
     // capacity.
@@ -461,6 +1214,28 @@ struct CuvkAllocations {
         VkExtent2D { mem_req.width, mem_req.height },
         nuniv_last_framebuf);
     }
+
+    // The base universe has a framebuffer of its own.
+    framebuf_refs.push_back(&evaluation_allocs.base_univ);
+    evaluation_allocs.base_univ_framebuf.emplace(
+      ctxt, pipes.eval_pipe.pipe.pass,
+      Span<const ImageView *>(&framebuf_refs.back(), 1),
+      VkExtent2D { mem_req.width, mem_req.height }, 1);
+
+    // Coarse universes are grouped into framebuffers in the same way.
+    if (mem_req.coarseLevel != 0) {
+      for (auto i = 0u; i < nframebuf; ++i) {
+        auto univ_offset = i * limits.maxFramebufferLayers;
+        auto nlayer = std::min(limits.maxFramebufferLayers,
+          mem_req.nuniv - univ_offset);
+        framebuf_refs.push_back(&evaluation_allocs.coarse_univs.emplace_back(
+          coarse_img.view(univ_offset, nlayer)));
+        evaluation_allocs.coarse_univ_framebufs.emplace_back(
+          ctxt, pipes.eval_pipe.pipe.pass,
+          Span<const ImageView *>(&framebuf_refs.back(), 1),
+          get_coarse_extent(mem_req), nlayer);
+      }
+    }
   }
   bool make() {
     if (!heap_mgr.make()) {
@@ -476,16 +1251,56 @@ struct CuvkAllocations {
         return false;
       }
     }
-    return true;
+    for (auto& img_view : evaluation_allocs.coarse_univs) {
+      if (!img_view.make()) {
+        return false;
+      }
+    }
+    for (auto& framebuf : evaluation_allocs.coarse_univ_framebufs) {
+      if (!framebuf.make()) {
+        return false;
+      }
+    }
+    return evaluation_allocs.sim_univs_temp_view.make() &&
+      evaluation_allocs.base_univ.make() &&
+      evaluation_allocs.base_univ_framebuf->make() &&
+      evaluation_allocs.coarse_univ_view.make();
   }
   void drop() {
+    evaluation_allocs.coarse_univ_view.drop();
+    for (auto& framebuf : evaluation_allocs.coarse_univ_framebufs) {
+      framebuf.drop();
+    }
+    for (auto& img_view : evaluation_allocs.coarse_univs) {
+      img_view.drop();
+    }
+    evaluation_allocs.base_univ_framebuf->drop();
+    evaluation_allocs.base_univ.drop();
+    evaluation_allocs.sim_univs_temp_view.drop();
     for (auto& framebuf : evaluation_allocs.sim_univs_temp_framebufs) {
       framebuf.drop();
     }
     for (auto& img_view : evaluation_allocs.sim_univs_temps) {
       img_view.drop();
     }
+    // Growable buffers are destroyed along with the heaps.
     heap_mgr.drop();
+    for (auto buf : growable_bufs()) {
+      buf->buf_alloc = nullptr;
+    }
+    evaluation_allocs.nbac_cap = 0;
+    evaluation_allocs.nuniv_cap = 0;
+  }
+  std::array<GrowableBuffer*, 7> growable_bufs() {
+    return {
+      &evaluation_allocs.bacs_buf,
+      &evaluation_allocs.staged_bacs_buf,
+      &evaluation_allocs.sorted_bacs_buf,
+      &evaluation_allocs.sim_univs_buf,
+      &evaluation_allocs.partial_costs_buf,
+      &evaluation_allocs.univ_costs_buf,
+      &evaluation_allocs.top_univs_buf,
+    };
   }
   ~CuvkAllocations() {
     drop();
@@ -500,23 +1315,126 @@ struct CuvkAllocations {
 
 struct Cuvk {
   Context ctxt;
+  const CuvkMemoryRequirements mem_req;
 
   CuvkPipelines pipes;
   CuvkAllocations allocs;
 
-  // We can't submit queues asynchronously.
-  std::mutex deform_send_sync, deform_fetch_sync,
+  // We can't submit queues asynchronously. Mutable so that tasks, which only
+  // refer to the context as constant, can submit too.
+  mutable std::mutex deform_send_sync, deform_fetch_sync,
    eval_send_sync, eval_fetch_sync,
    submit_sync;
+
+  // Cost of the resident base universe. Only valid when `has_base` is true.
+  // Both are guarded by `submit_sync`.
+  float base_cost;
+  bool has_base;
+  // Incremented each time an evaluation task overwrites rendered universes.
+  // Guarded by `submit_sync`.
+  uint64_t eval_gen;
+  // Whether each of the resident real universe slots is in use. Guarded by
+  // `submit_sync`.
+  std::vector<bool> real_univ_slots_used;
+  // Whether the weight map has been set. Guarded by `submit_sync`.
+  bool has_weight_map;
+  // Host buffers allocated by `cuvkAllocHostBuffer`, by their mapped
+  // addresses. Guarded by `host_buf_sync`.
+  std::map<const char*, const BufferAllocation*> host_bufs;
+  mutable std::mutex host_buf_sync;
   
   Cuvk(const PhysicalDeviceInfo& phys_dev_info,
     const CuvkMemoryRequirements& mem_req) :
     ctxt(phys_dev_info, CUVK_PHYS_DEV_FEAT, CUVK_QUEUE_CAPS),
+    mem_req(mem_req),
     pipes(ctxt, mem_req),
     allocs(ctxt, pipes, mem_req,
-      MemoryAllocationGuidelines(ctxt, pipes, mem_req)) {}
+      MemoryAllocationGuidelines(phys_dev_info, mem_req)),
+    base_cost(0.),
+    has_base(false),
+    eval_gen(0),
+    real_univ_slots_used(mem_req.nRealUniv, false),
+    has_weight_map(false) {}
   bool make() {
-    return ctxt.make() && pipes.make() && allocs.make();
+    auto& limits = ctxt.req.phys_dev_info->phys_dev_props.limits;
+    // Evaluation buffers are made large enough for a batch of bacteria
+    // deformation outputs, and a single universe. They grow on demand.
+    return ctxt.make() && pipes.make() && allocs.make() &&
+      grow_eval_bufs(std::min(mem_req.nspec * mem_req.nbac,
+        get_max_eval_nbac(limits, mem_req)), 1);
+  }
+  // Grow the evaluation buffers of bacteria, rendered universes and costs to
+  // hold `nbac` bacteria and `nuniv` universes, which must not exceed
+  // `get_max_eval_nbac` and `mem_req.nuniv`. Capacities are at least doubled
+  // to avoid frequent reallocation. Returns false if the buffers can't grow,
+  // in which case the capacities are left unchanged. Descriptor sets and
+  // command buffers that refer to the buffers must be updated afterwards, so
+  // this must be called with `submit_sync` held.
+  bool grow_eval_bufs(uint32_t nbac, uint32_t nuniv) {
+    auto& eval_allocs = allocs.evaluation_allocs;
+    auto& limits = ctxt.req.phys_dev_info->phys_dev_props.limits;
+    if (nbac <= eval_allocs.nbac_cap && nuniv <= eval_allocs.nuniv_cap) {
+      return true;
+    }
+    auto nbac_cap = std::max(nbac, eval_allocs.nbac_cap);
+    if (nbac > eval_allocs.nbac_cap && eval_allocs.nbac_cap != 0) {
+      nbac_cap = std::min(std::max(nbac, 2 * eval_allocs.nbac_cap),
+        get_max_eval_nbac(limits, mem_req));
+    }
+    auto nuniv_cap = std::max(nuniv, eval_allocs.nuniv_cap);
+    if (nuniv > eval_allocs.nuniv_cap && eval_allocs.nuniv_cap != 0) {
+      nuniv_cap = std::min(std::max(nuniv, 2 * eval_allocs.nuniv_cap),
+        mem_req.nuniv);
+    }
+    auto& heap_mgr = allocs.heap_mgr;
+    EvaluationBufferSizes sizes(limits, mem_req, nbac_cap, nuniv_cap);
+    auto succ = eval_allocs.bacs_buf.grow(heap_mgr, sizes.bacs) &&
+      (!eval_allocs.is_input_staged ||
+        eval_allocs.staged_bacs_buf.grow(heap_mgr, sizes.bacs)) &&
+      eval_allocs.sorted_bacs_buf.grow(heap_mgr, sizes.sorted_bacs) &&
+      eval_allocs.sim_univs_buf.grow(heap_mgr, sizes.sim_univs) &&
+      eval_allocs.partial_costs_buf.grow(heap_mgr, sizes.partial_costs) &&
+      eval_allocs.univ_costs_buf.grow(heap_mgr, sizes.univ_costs) &&
+      eval_allocs.top_univs_buf.grow(heap_mgr, sizes.top_univs);
+    if (succ) {
+      LOG.info("evaluation buffers are grown to hold {} bacteria and {} "
+        "universes", nbac_cap, nuniv_cap);
+      eval_allocs.nbac_cap = nbac_cap;
+      eval_allocs.nuniv_cap = nuniv_cap;
+    } else {
+      LOG.warning("unable to grow evaluation buffers to hold {} bacteria and "
+        "{} universes", nbac_cap, nuniv_cap);
+      if (eval_allocs.nbac_cap == 0) {
+        return false;
+      }
+      // Buffers are never shrunk, so the slices of the previous capacities
+      // are taken from the buffers as they are now.
+      sizes = EvaluationBufferSizes(limits, mem_req, eval_allocs.nbac_cap,
+        eval_allocs.nuniv_cap);
+    }
+    // Some of the buffers might have been reallocated.
+    eval_allocs.bacs = eval_allocs.bacs_buf.slice(sizes.bacs);
+    eval_allocs.dev_bacs = eval_allocs.is_input_staged ?
+      eval_allocs.staged_bacs_buf.slice(sizes.bacs) : eval_allocs.bacs;
+    eval_allocs.bacs_slots.clear();
+    eval_allocs.dev_bacs_slots.clear();
+    for (auto i = 0u; i < NBAC_SLOT; ++i) {
+      eval_allocs.bacs_slots.push_back(eval_allocs.bacs.slice(
+        i * sizes.bacs_stride, sizes.bacs_stride));
+      eval_allocs.dev_bacs_slots.push_back(eval_allocs.dev_bacs.slice(
+        i * sizes.bacs_stride, sizes.bacs_stride));
+    }
+    eval_allocs.sorted_bacs = eval_allocs.sorted_bacs_buf.slice(
+      sizes.sorted_bacs);
+    eval_allocs.sim_univs = eval_allocs.sim_univs_buf.slice(sizes.sim_univs);
+    eval_allocs.partial_costs = eval_allocs.partial_costs_buf.slice(
+      sizes.partial_costs);
+    eval_allocs.univ_costs = eval_allocs.univ_costs_buf.slice(
+      sizes.univ_costs);
+    eval_allocs.top_univs = eval_allocs.top_univs_buf.slice(sizes.top_univs);
+    // Rendered universes of finished tasks might have been freed.
+    ++eval_gen;
+    return succ;
   }
   void drop() {
     allocs.drop();
@@ -534,14 +1452,29 @@ struct Task {
   Executable exec;
   DescriptorSet desc_set;
   Fence fence;
+  // Uploads of staged evaluation inputs, submitted apart from `exec` so that
+  // they can overlap with the evaluation of the previous chunk.
+  Executable upload_exec;
+  Fence upload_fence;
 
   std::future<CuvkTaskStatus> status;
 
+  // Generation of the rendered universes of a finished evaluation task, or 0
+  // if there is none. Rendered universes can be fetched only if it matches
+  // `Cuvk::eval_gen`. Guarded by `Cuvk::submit_sync`.
+  uint64_t eval_gen;
+  // Number of universes rendered by the evaluation task.
+  uint32_t nsim_univ;
+
   Task(const Cuvk& cuvk, const DescriptorSetLayout& desc_set_layout) :
     cuvk(cuvk),
     exec(cuvk.ctxt, cuvk.ctxt.queues[0]),
     desc_set(cuvk.ctxt, desc_set_layout),
-    fence(cuvk.ctxt) {}
+    fence(cuvk.ctxt),
+    upload_exec(cuvk.ctxt, cuvk.ctxt.queues[0]),
+    upload_fence(cuvk.ctxt),
+    eval_gen(0),
+    nsim_univ(0) {}
   bool make() {
     exec.make();
     desc_set.make();
@@ -549,6 +1482,97 @@ struct Task {
   }
 };
 
+// The slice of the host buffer `size` bytes at `host_ptr` lie in, if they are
+// in a host buffer allocated by `cuvkAllocHostBuffer` and can be bound there.
+std::optional<BufferSlice> find_host_buf(const Cuvk& cuvk,
+  const void* host_ptr, size_t size) {
+  if (host_ptr == nullptr || size == 0) {
+    return std::nullopt;
+  }
+  auto ptr = static_cast<const char*>(host_ptr);
+  std::scoped_lock _(cuvk.host_buf_sync);
+  auto it = cuvk.host_bufs.upper_bound(ptr);
+  if (it == cuvk.host_bufs.begin()) {
+    return std::nullopt;
+  }
+  --it;
+  auto& buf_alloc = *it->second;
+  VkDeviceSize offset = ptr - it->first;
+  if (offset + size > buf_alloc.req.size) {
+    return std::nullopt;
+  }
+  auto& limits = cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
+  if (offset % limits.minStorageBufferOffsetAlignment != 0) {
+    LOG.warning("host buffer range at offset {} is not aligned for the "
+      "device; it's copied instead", offset);
+    return std::nullopt;
+  }
+  return buf_alloc.slice(offset, size);
+}
+
+// Whether host memory at `host_ptr` can be imported, which requires the device
+// to support importing and the address to be aligned to
+// `minImportedHostPointerAlignment`.
+bool is_host_ptr_importable(const Cuvk& cuvk, const void* host_ptr) {
+  auto align = cuvk.ctxt.req.phys_dev_info->min_imported_host_ptr_align;
+  return host_ptr != nullptr && align > 0 &&
+    reinterpret_cast<uintptr_t>(host_ptr) % align == 0;
+}
+// Host memory of the caller imported as a buffer for the lifetime of a task, so
+// that the device reads and writes it in place. Falls back to the staging
+// buffer if the memory can't be imported.
+struct ImportedBuffer {
+  HeapManager& heap_mgr;
+  std::optional<BufferSlice> host_buf_slice;
+  const BufferAllocation* buf_alloc;
+  BufferSlice slice;
+
+  // Memory in host buffers is used as is. Other memory is imported if it's
+  // aligned for importing. The device never writes to the memory of inputs,
+  // though they are given in const pointers.
+  ImportedBuffer(Cuvk& cuvk, const void* host_ptr, size_t size,
+    const BufferSlice& staging) :
+    heap_mgr(cuvk.allocs.heap_mgr),
+    host_buf_slice(find_host_buf(cuvk, host_ptr, size)),
+    buf_alloc(!host_buf_slice && size > 0 &&
+      is_host_ptr_importable(cuvk, host_ptr) ?
+      heap_mgr.import_buf(const_cast<void*>(host_ptr), size,
+        staging.buf_alloc->req.usage) :
+      nullptr),
+    slice(host_buf_slice ? *host_buf_slice :
+      buf_alloc != nullptr ? buf_alloc->slice(0, size) : staging) {
+    if (!is_in_place() && size > 0 && is_host_ptr_importable(cuvk, host_ptr)) {
+      LOG.warning("unable to import host memory; it's copied instead");
+    }
+  }
+  ~ImportedBuffer() {
+    if (buf_alloc != nullptr) {
+      heap_mgr.free_buf(*buf_alloc);
+    }
+  }
+  ImportedBuffer(const ImportedBuffer&) = delete;
+  ImportedBuffer& operator=(const ImportedBuffer&) = delete;
+
+  // Whether the caller's memory is accessed by the device in place.
+  bool is_in_place() const {
+    return host_buf_slice || buf_alloc != nullptr;
+  }
+  // Send `size` bytes of `data` to the device, or make the memory used in
+  // place visible to it.
+  bool send(const void* data, size_t size) const {
+    return is_in_place() ?
+      slice.dev_mem_view().flush(size) :
+      slice.dev_mem_view().send(data, size);
+  }
+  // Fetch `size` bytes from the device to `data`, or make the memory used in
+  // place visible to the host.
+  bool fetch(L_OUT void* data, size_t size) const {
+    return is_in_place() ?
+      slice.dev_mem_view().invalidate(size) :
+      slice.dev_mem_view().fetch(data, size);
+  }
+};
+
 std::string gen_phys_dev_json() {
   std::string rv;
   for (auto phys_dev_info : vk.phys_dev_infos) {
@@ -572,6 +1596,11 @@ CuvkResult L_STDCALL cuvkInitialize(CuvkBool debug) {
     printf("failed to set up logger");
     std::terminate();
   }
+  // Host transfers can still be made on the calling threads without the
+  // transfer engine.
+  if (!TRANSFER.make()) {
+    LOG.warning("unable to start transfer threads");
+  }
   if (debug) {
     if (!vk.make_debug()) {
       return false;
@@ -596,6 +1625,7 @@ void L_STDCALL cuvkEnumeratePhysicalDevices(L_OUT char* pJson,
 
 L_EXPORT void L_STDCALL cuvkDeinitialize() {
   vk.drop();
+  TRANSFER.drop();
   LOG.drop();
 }
 
@@ -609,17 +1639,70 @@ bool check_dev_cap(L_INOUT uint32_t& value, uint32_t limit,
   }
   return true;
 }
-bool check_dev_caps(const VkPhysicalDeviceLimits& limits,
-  L_INOUT CuvkMemoryRequirements& mem_req) {
-  LOG.warning("as cuvk is still in progress, some variables can be constrained "
-    "by hardware limits until workarounds are implemented");
-  {
-    auto limit = std::min({
-      limits.maxComputeWorkGroupCount[0],
-      limits.maxStorageBufferRange / (uint32_t)sizeof(DeformSpecs),
-    });
-    check_dev_cap(
-      mem_req.nspec, limits.maxComputeWorkGroupCount[0],
+// Number of descriptors of type `ty` visible to any of `stages` in the
+// evaluation descriptor set layout.
+uint32_t count_eval_descs(VkShaderStageFlags stages, VkDescriptorType ty) {
+  uint32_t rv = 0;
+  for (auto& bind : EVAL_DESC_LAYOUT_BINDS) {
+    if ((bind.stageFlags & stages) != 0 && bind.descriptorType == ty) {
+      rv += bind.descriptorCount;
+    }
+  }
+  return rv;
+}
+// Evaluation binds all of its resources in a single descriptor set, which must
+// fit in the descriptor limits of the device.
+bool check_eval_descs(const VkPhysicalDeviceLimits& limits) {
+  for (auto stage : {
+    VK_SHADER_STAGE_COMPUTE_BIT, VK_SHADER_STAGE_FRAGMENT_BIT,
+  }) {
+    auto nstorage_buf =
+      count_eval_descs(stage, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    auto nsampler =
+      count_eval_descs(stage, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    if (nstorage_buf > limits.maxPerStageDescriptorStorageBuffers ||
+      nsampler > limits.maxPerStageDescriptorSamplers ||
+      nsampler > limits.maxPerStageDescriptorSampledImages ||
+      nstorage_buf + nsampler > limits.maxPerStageResources) {
+      LOG.error("(evaluation) {} storage buffers and {} samplers exceed the "
+        "per-stage descriptor limits of device (storage buffers={}; "
+        "samplers={}; resources={})", nstorage_buf, nsampler,
+        limits.maxPerStageDescriptorStorageBuffers,
+        std::min(limits.maxPerStageDescriptorSamplers,
+          limits.maxPerStageDescriptorSampledImages),
+        limits.maxPerStageResources);
+      return false;
+    }
+  }
+  auto nstorage_buf =
+    count_eval_descs(VK_SHADER_STAGE_ALL, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  auto nsampler = count_eval_descs(VK_SHADER_STAGE_ALL,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  if (nstorage_buf > limits.maxDescriptorSetStorageBuffers ||
+    nsampler > limits.maxDescriptorSetSamplers ||
+    nsampler > limits.maxDescriptorSetSampledImages) {
+    LOG.error("(evaluation) {} storage buffers and {} samplers exceed the "
+      "descriptor set limits of device (storage buffers={}; samplers={})",
+      nstorage_buf, nsampler, limits.maxDescriptorSetStorageBuffers,
+      std::min(limits.maxDescriptorSetSamplers,
+        limits.maxDescriptorSetSampledImages));
+    return false;
+  }
+  return true;
+}
+bool check_dev_caps(const VkPhysicalDeviceLimits& limits,
+  L_INOUT CuvkMemoryRequirements& mem_req) {
+  if (!check_eval_descs(limits)) {
+    return false;
+  }
+  // Batch sizes are constrained by hardware limits. Larger invocations are
+  // split into chunks of the constrained sizes.
+  {
+    auto limit = std::min({
+      limits.maxComputeWorkGroupCount[0],
+      limits.maxStorageBufferRange / (uint32_t)sizeof(DeformSpecs),
+    });
+    check_dev_cap(mem_req.nspec, limit,
       "(deformation) number of deform specs");
   } {
     auto limit = std::min({
@@ -650,14 +1733,62 @@ bool check_dev_caps(const VkPhysicalDeviceLimits& limits,
   return true;
 }
 
+// Validate memory requirements, and lower them to device limits.
+bool check_mem_req(const PhysicalDeviceInfo& phys_dev_info,
+  L_INOUT CuvkMemoryRequirements* memoryRequirements) {
+  auto& limits = phys_dev_info.phys_dev_props.limits;
+  if (memoryRequirements->simUnivFormat > CUVK_SIM_UNIV_FORMAT_BIT) {
+    LOG.error("unknown simulated universe format");
+    return false;
+  }
+  if (memoryRequirements->costMode > CUVK_COST_MODE_COVERAGE) {
+    LOG.error("unknown cost mode");
+    return false;
+  }
+  if (memoryRequirements->costMode == CUVK_COST_MODE_COVERAGE &&
+    memoryRequirements->width * memoryRequirements->height > (1 << 23)) {
+    LOG.error("universes are too large for coverage cost mode");
+    return false;
+  }
+  if (memoryRequirements->costMetric > CUVK_COST_METRIC_DICE) {
+    LOG.error("unknown cost metric");
+    return false;
+  }
+  if (memoryRequirements->costMode == CUVK_COST_MODE_COVERAGE &&
+    memoryRequirements->costMetric != CUVK_COST_METRIC_L1) {
+    LOG.error("coverage cost mode only supports L1 metric");
+    return false;
+  }
+  if (memoryRequirements->costMetric == CUVK_COST_METRIC_TRUNCATED_L1 &&
+    !(memoryRequirements->truncation > 0.f)) {
+    LOG.error("truncation of truncated L1 metric must be positive");
+    return false;
+  }
+  if (memoryRequirements->useWeightMap &&
+    (memoryRequirements->costMode == CUVK_COST_MODE_COVERAGE ||
+    memoryRequirements->coarseLevel != 0)) {
+    LOG.error("weight map can't be used in coverage cost mode or "
+      "coarse-to-fine evaluation");
+    return false;
+  }
+  // Each level of the real universe pyramid must have at least a pixel.
+  if (memoryRequirements->coarseLevel != 0 &&
+    (memoryRequirements->coarseLevel >= 32 ||
+    (1u << (memoryRequirements->coarseLevel - 1)) >=
+    std::max(memoryRequirements->width, memoryRequirements->height))) {
+    LOG.error("coarse level is too high for the universe size");
+    return false;
+  }
+  // Ensure device is capable of the CUVK tasks.
+  return check_dev_caps(limits, *memoryRequirements);
+}
+
 CuvkResult L_STDCALL cuvkCreateContext(
   CuvkSize physicalDeviceIndex,
   L_INOUT CuvkMemoryRequirements* memoryRequirements,
   L_OUT CuvkContext* pContext) {
   auto& phys_dev_info = vk.phys_dev_infos[physicalDeviceIndex];
-  auto& limits = phys_dev_info.phys_dev_props.limits;
-  // Ensure device is capable of the CUVK tasks.
-  if (!check_dev_caps(limits, *memoryRequirements)) {
+  if (!check_mem_req(phys_dev_info, memoryRequirements)) {
     return false;
   }
   // Create the context.
@@ -671,6 +1802,41 @@ CuvkResult L_STDCALL cuvkCreateContext(
   }
 }
 
+CuvkResult L_STDCALL cuvkEstimateMemory(
+  CuvkSize physicalDeviceIndex,
+  L_INOUT CuvkMemoryRequirements* memoryRequirements,
+  L_OUT CuvkMemoryBreakdown* pEstimate) {
+  auto& phys_dev_info = vk.phys_dev_infos[physicalDeviceIndex];
+  if (!check_mem_req(phys_dev_info, memoryRequirements)) {
+    return false;
+  }
+  auto& mem_req = *memoryRequirements;
+  MemoryAllocationGuidelines req(phys_dev_info, mem_req);
+  // Images are laid out as `CuvkAllocations` declares them.
+  auto texel_size = get_sim_univ_texel_size(mem_req);
+  VkDeviceSize univ_img_size = mem_req.width * mem_req.height * texel_size;
+  auto coarse_extent = get_coarse_extent(mem_req);
+  VkDeviceSize coarse_img_size =
+    coarse_extent.width * coarse_extent.height * texel_size;
+  // Evaluation buffers are estimated as if they have grown to a batch of
+  // bacteria deformation outputs and `nuniv` universes.
+  auto& limits = phys_dev_info.phys_dev_props.limits;
+  EvaluationBufferSizes eval_buf_sizes(limits, mem_req,
+    std::min(mem_req.nspec * mem_req.nbac, get_max_eval_nbac(limits, mem_req)),
+    mem_req.nuniv);
+  pEstimate->hostVisibleSize = (VkDeviceSize)req.hv_buf_sizer +
+    eval_buf_sizes.bacs + eval_buf_sizes.sim_univs +
+    eval_buf_sizes.partial_costs + eval_buf_sizes.univ_costs +
+    eval_buf_sizes.top_univs;
+  pEstimate->deviceOnlySize = (VkDeviceSize)req.do_buf_sizer +
+    (req.evaluation.is_input_staged ? eval_buf_sizes.bacs : 0) +
+    eval_buf_sizes.sorted_bacs;
+  pEstimate->imageSize =
+    univ_img_size * ((uint32_t)req.do_img_sizer + 1) +
+    coarse_img_size * (mem_req.coarseLevel != 0 ? mem_req.nuniv : 1);
+  return true;
+}
+
 void L_STDCALL cuvkDestroyContext(
   CuvkContext context) {
   delete reinterpret_cast<Cuvk*>(context);
@@ -681,16 +1847,34 @@ void L_STDCALL cuvkDestroyContext(
 namespace deformation {
   using Invocation = CuvkDeformationInvocation;
 
-  void write_desc_set(L_INOUT Task& task) {
-    auto& allocs = task.cuvk.allocs.deformation_allocs;
+  // Buffers a deformation task works on. The caller's memory is used in place
+  // if it can be imported.
+  struct Buffers {
+    ImportedBuffer deform_specs;
+    ImportedBuffer bacs;
+    ImportedBuffer bacs_out;
+
+    Buffers(Cuvk& cuvk, const Invocation& invoke) :
+      deform_specs(cuvk, invoke.pDeformSpecs,
+        invoke.nSpec * sizeof(DeformSpecs),
+        cuvk.allocs.deformation_allocs.deform_specs),
+      bacs(cuvk, invoke.pBacs,
+        invoke.nBac * sizeof(Bacterium),
+        cuvk.allocs.deformation_allocs.bacs),
+      bacs_out(cuvk, invoke.pBacsOut,
+        invoke.nBac * invoke.nSpec * sizeof(Bacterium),
+        cuvk.allocs.deformation_allocs.bacs_out) {}
+  };
+
+  void write_desc_set(L_INOUT Task& task, const Buffers& bufs) {
     // Update descriptor set.
     task.desc_set
-      .write(0, allocs.deform_specs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
-      .write(1, allocs.bacs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
-      .write(2, allocs.bacs_out, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+      .write(0, bufs.deform_specs.slice, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(1, bufs.bacs.slice, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(2, bufs.bacs_out.slice, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
   }
-  bool fill_cmd_buf(L_INOUT Task& task, const Invocation& invoke) {
-    auto& allocs = task.cuvk.allocs.deformation_allocs;
+  bool fill_cmd_buf(L_INOUT Task& task, const Invocation& invoke,
+    const Buffers& bufs) {
     std::array<uint32_t, 3> meta {
       invoke.nBac,
       invoke.baseUniv,
@@ -703,9 +1887,9 @@ namespace deformation {
       // -----------------------------------------------------------------------
       // Wait for inputs to be fully written.
       .from_stage(VK_PIPELINE_STAGE_HOST_BIT)
-        .barrier(allocs.deform_specs,
+        .barrier(bufs.deform_specs.slice,
           VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-        .barrier(allocs.bacs,
+        .barrier(bufs.bacs.slice,
           VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
       .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
       // -----------------------------------------------------------------------
@@ -717,28 +1901,25 @@ namespace deformation {
       // -----------------------------------------------------------------------
       // Wait for host to read.
       .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
-        .barrier(allocs.bacs_out,
+        .barrier(bufs.bacs_out.slice,
           VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
       .to_stage(VK_PIPELINE_STAGE_HOST_BIT);
     return rec.end();
   }
-  bool input(L_INOUT Task& task, const Invocation& invoke) {
-    auto& allocs = task.cuvk.allocs.deformation_allocs;
-    if (!allocs.deform_specs.dev_mem_view().send(
+  bool input(const Invocation& invoke, const Buffers& bufs) {
+    if (!bufs.deform_specs.send(
       invoke.pDeformSpecs, invoke.nSpec * sizeof(DeformSpecs))) {
       LOG.error("unable to send bacteria input");
       return false;
     }
-    if (!allocs.bacs.dev_mem_view().send(
-      invoke.pBacs, invoke.nBac * sizeof(Bacterium))) {
+    if (!bufs.bacs.send(invoke.pBacs, invoke.nBac * sizeof(Bacterium))) {
       LOG.error("unable to send deform specs input");
       return false;
     }
     return true;
   }
-  bool output(L_INOUT Task& task, const Invocation& invoke) {
-    auto& allocs = task.cuvk.allocs.deformation_allocs;
-    if (!allocs.bacs_out.dev_mem_view().fetch(
+  bool output(const Invocation& invoke, const Buffers& bufs) {
+    if (!bufs.bacs_out.fetch(
       invoke.pBacsOut,
       invoke.nBac * invoke.nSpec * sizeof(Bacterium))) {
       LOG.error("unable to fetch bacteria output");
@@ -746,11 +1927,92 @@ namespace deformation {
     }
     return true;
   }
+  // Deform specs and bacteria are split into chunks if they don't fit in the
+  // context. Each chunk deforms a range of bacteria by a range of specs, and
+  // its output rows are fetched into their places in `pBacsOut`.
+  bool needs_chunking(const Cuvk& cuvk, const Invocation& invoke) {
+    return invoke.nSpec > cuvk.mem_req.nspec || invoke.nBac > cuvk.mem_req.nbac;
+  }
+  bool run_chunk(Cuvk& cuvk, L_INOUT Task& task, const Invocation& invoke,
+    uint32_t spec_offset, uint32_t bac_offset) {
+    auto specs = reinterpret_cast<const DeformSpecs*>(invoke.pDeformSpecs);
+    auto bacs = reinterpret_cast<const Bacterium*>(invoke.pBacs);
+    Invocation chunk_invoke {
+      specs + spec_offset,
+      std::min(invoke.nSpec - spec_offset, cuvk.mem_req.nspec),
+      bacs + bac_offset,
+      std::min(invoke.nBac - bac_offset, cuvk.mem_req.nbac),
+      // Universe IDs are offset by the specs skipped.
+      invoke.baseUniv + spec_offset * invoke.nUniv,
+      invoke.nUniv,
+      // Output rows of a chunk are scattered in `pBacsOut`, so the chunk is
+      // output to the staging buffer.
+      nullptr,
+    };
+    // Chunks start in the middle of the caller's arrays, so their inputs are
+    // only imported if they happen to be aligned for it, and copied otherwise.
+    Buffers bufs(cuvk, chunk_invoke);
+    write_desc_set(task, bufs);
+    if (!task.exec.make() || !fill_cmd_buf(task, chunk_invoke, bufs) ||
+      !task.fence.make()) {
+      LOG.error("unable to fill command buffer for deformation chunk");
+      return false;
+    }
+    if (!input(chunk_invoke, bufs)) {
+      LOG.error("unable to send deformation input to device");
+      return false;
+    }
+    if (!task.exec.execute().submit(task.fence)) {
+      LOG.error("unable to submit deformation command buffer");
+      return false;
+    }
+    if (task.fence.wait() == FenceStatus::Error) {
+      LOG.error("unable to wait the fence of deformation");
+      return false;
+    }
+    // Rows are contiguous in `pBacsOut` if the chunk covers all bacteria.
+    auto dst = reinterpret_cast<Bacterium*>(invoke.pBacsOut) +
+      spec_offset * invoke.nBac + bac_offset;
+    auto row_size = chunk_invoke.nBac * sizeof(Bacterium);
+    auto& bacs_out = bufs.bacs_out.slice;
+    if (chunk_invoke.nBac == invoke.nBac) {
+      if (!bacs_out.dev_mem_view().fetch(dst, chunk_invoke.nSpec * row_size)) {
+        LOG.error("unable to fetch deformation output from device");
+        return false;
+      }
+      return true;
+    }
+    for (auto i = 0u; i < chunk_invoke.nSpec; ++i) {
+      auto row = bacs_out.slice(i * row_size, row_size);
+      if (!row.dev_mem_view().fetch(dst + i * invoke.nBac, row_size)) {
+        LOG.error("unable to fetch deformation output from device");
+        return false;
+      }
+    }
+    return true;
+  }
+  CuvkTaskStatus chunked_main(Cuvk* cuvk, L_INOUT Task* task,
+    const Invocation& invoke) {
+    std::scoped_lock _(cuvk->submit_sync);
+    for (auto i = 0u; i < invoke.nSpec; i += cuvk->mem_req.nspec) {
+      for (auto j = 0u; j < invoke.nBac; j += cuvk->mem_req.nbac) {
+        if (!run_chunk(*cuvk, *task, invoke, i, j)) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+      }
+    }
+    LOG.info("chunked deformation task is done");
+    return CUVK_TASK_STATUS_OK;
+  }
   CuvkTaskStatus worker_main(Cuvk* cuvk, L_INOUT Task* task,
     Invocation invoke) {
-    write_desc_set(*task);
+    if (needs_chunking(*cuvk, invoke)) {
+      return chunked_main(cuvk, task, invoke);
+    }
+    Buffers bufs(*cuvk, invoke);
+    write_desc_set(*task, bufs);
     // Prepare for execution.
-    if (!fill_cmd_buf(*task, invoke)) {
+    if (!fill_cmd_buf(*task, invoke, bufs)) {
       LOG.error("unable to fill command buffer for deformation task");
       return CUVK_TASK_STATUS_ERROR;
     }
@@ -762,7 +2024,7 @@ namespace deformation {
     { // std::scoped_lock _(ctxt->submit_sync)
       std::scoped_lock _(cuvk->submit_sync);
       // Send input.
-      if (!input(*task, invoke)) {
+      if (!input(invoke, bufs)) {
         LOG.error("unable to send deformation input to device");
         return CUVK_TASK_STATUS_ERROR;
       }
@@ -778,7 +2040,7 @@ namespace deformation {
         return CUVK_TASK_STATUS_ERROR;
       }
       // Fetch output.
-      if (!output(*task, invoke)) {
+      if (!output(invoke, bufs)) {
         LOG.error("unable to fetch deformation output from device");
         return CUVK_TASK_STATUS_ERROR;
       }
@@ -842,254 +2104,1954 @@ CuvkResult L_STDCALL cuvkInvokeDeformation(
 
 
 
-namespace evaluation {
-  using Invocation = CuvkEvaluationInvocation;
-
-  void write_desc_set(L_INOUT Task& task) {
-    auto& allocs = task.cuvk.allocs.evaluation_allocs;
-    task.desc_set
-      .write(0, allocs.real_univ, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
-      .write(1, allocs.sim_univs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
-      .write(2, allocs.sum_temp, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
-      .write(3, allocs.partial_costs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+// Send the real universe to device. The real universe is binarized and packed
+// if simulated universes are bit-packed.
+bool send_real_univ(const Cuvk& cuvk, const void* real_univ,
+  uint32_t width, uint32_t height) {
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  auto npx = width * height;
+  if (cuvk.mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT) {
+    auto src = reinterpret_cast<const float*>(real_univ);
+    std::vector<uint32_t> bits((npx + 31) / 32, 0);
+    for (auto i = 0u; i < npx; ++i) {
+      if (src[i] > 0.5f) {
+        bits[i >> 5] |= 1u << (i & 31);
+      }
+    }
+    return allocs.real_univ.dev_mem_view().send(
+      bits.data(), bits.size() * sizeof(uint32_t));
+  } else {
+    return allocs.real_univ.dev_mem_view().send(
+      real_univ, npx * sizeof(float));
   }
-  bool fill_cmd_buf(L_INOUT Task& task, const Invocation& invoke) {
-    using shader_interface::Bacterium;
-    auto& allocs = task.cuvk.allocs.evaluation_allocs;
-
-    auto rec = task.exec.record();
-    if (!rec.begin()) { return false; }
-
-    auto& limits = task.cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
-    auto bacs = reinterpret_cast<const Bacterium*>(invoke.pBacs);
-
-    struct {
-      uint32_t base_univ; // This will be added with `invoke` for multiple times.
-      float ratio;
-    } eval_meta {
-      invoke.baseUniv,
-      (float)invoke.width / (float)invoke.height,
-    };
-
-    rec
-      // -----------------------------------------------------------------------
-      // Wait for bacteria data to be written.
-      .from_stage(VK_PIPELINE_STAGE_HOST_BIT)
-        .barrier(allocs.bacs,
-          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT)
-      .to_stage(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
-    uint32_t bacs_pos = 0;
-    uint32_t univ_pos = invoke.baseUniv;
-    uint32_t bacs_offset = 0;
-    uint32_t ngrp = (invoke.nSimUniv + limits.maxFramebufferLayers - 1)
-      / limits.maxFramebufferLayers;
-    for (auto i = 0u; i < ngrp; ++i) {
-      bacs_pos = bacs_offset;
-      // The number of universes that can be simulated is limited by the number
-      // of layers that can be shoved into a single framebuffer.
-      univ_pos += limits.maxFramebufferLayers;
-      // Find the number of bacteria to be drawn in this batch. We assume that
-      // all bacteria are sorted by universe ID.
-      while (bacs_pos < invoke.nBac && bacs[bacs_pos].univ < univ_pos) {
-        ++bacs_pos;
-      }
-
-      // Draw calls.
-      auto nbac = bacs_pos - bacs_offset;
-      auto& img_view = allocs.sim_univs_temps[i];
-      auto& framebuf = allocs.sim_univs_temp_framebufs[i];
-      rec
-        // ---------------------------------------------------------------------
-        // Rearrange simulated universes output layout.
-        .from_stage(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
-          .barrier(img_view,
-            0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-        .to_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
-        // ---------------------------------------------------------------------
-        // Draw simulated cell universes.
-        .push_const(task.cuvk.pipes.eval_pipe.pipe,
-          VK_SHADER_STAGE_GEOMETRY_BIT,
-          0, sizeof(eval_meta), &eval_meta)
-        .draw(task.cuvk.pipes.eval_pipe.pipe, {},
-          allocs.bacs.slice(bacs_offset, nbac), nbac, framebuf)
-        .copy_img_to_buf(allocs.sim_univs_temp_entire, allocs.sim_univs);
-
-      // Update states.
-      bacs_offset = bacs_pos;
-      eval_meta.base_univ = univ_pos;
+}
+// Sum up the pixels of the real universe, as the device sees it. This is the
+// cost of an empty simulated universe.
+float sum_real_univ(const Cuvk& cuvk, const void* real_univ,
+  uint32_t width, uint32_t height) {
+  auto npx = width * height;
+  auto src = reinterpret_cast<const float*>(real_univ);
+  auto is_bit_packed = cuvk.mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT;
+  double sum = 0.;
+  for (auto i = 0u; i < npx; ++i) {
+    if (is_bit_packed) {
+      sum += src[i] > 0.5f ? 1. : 0.;
+    } else {
+      sum += src[i];
     }
-    rec
-      // -----------------------------------------------------------------------
-      // Copy the simulated universes out.
-      // TODO: (penguinliong) Use another queue for copy in the future.
-      // -----------------------------------------------------------------------
-      // Wait for the compute shader to read.
-      .from_stage(VK_PIPELINE_STAGE_TRANSFER_BIT)
-        .barrier(allocs.sim_univs,
-          VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
-      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
-
-    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
-
-    if (scheduling.nsec != 0) {
-      std::array<uint32_t, 4> cost_meta {
-        scheduling.nsec_actual,
-        scheduling.npack_sec,
-        scheduling.npack_univ,
-        0,
-      };
-      rec
-        // ---------------------------------------------------------------------
-        // Dispatch cost computation.
-        .push_const(task.cuvk.pipes.cost_pipe.pipe_sec,
-          0, (uint32_t)cost_meta.size() * sizeof(uint32_t), cost_meta.data())
-        .dispatch(task.cuvk.pipes.cost_pipe.pipe_sec, &task.desc_set,
-          invoke.nSimUniv, scheduling.nsec, 1);
-    }
-    if (scheduling.npack_res != 0) {
-      std::array<uint32_t, 4> cost_meta {
-        scheduling.nsec_actual,
-        scheduling.npack_res,
-        scheduling.npack_univ,
-        scheduling.nsec,
-      };
-      rec
-        // ---------------------------------------------------------------------
-        // Dispatch cost computation for residuals.
-        .push_const(task.cuvk.pipes.cost_pipe.pipe_res,
-          0, (uint32_t)cost_meta.size() * sizeof(uint32_t), cost_meta.data())
-        .dispatch(task.cuvk.pipes.cost_pipe.pipe_res, &task.desc_set,
-          invoke.nSimUniv, 1, 1);
+  }
+  return (float)sum;
+}
+// Summed-area table of the real universe, as the device sees it. There are
+// `(width + 1) * (height + 1)` elements; the first row and column are zeros.
+std::vector<double> make_real_univ_integral(const Cuvk& cuvk,
+  const void* real_univ, uint32_t width, uint32_t height) {
+  auto src = reinterpret_cast<const float*>(real_univ);
+  auto is_bit_packed = cuvk.mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT;
+  auto stride = width + 1;
+  std::vector<double> rv(stride * (height + 1), 0.);
+  for (auto y = 0u; y < height; ++y) {
+    double row_sum = 0.;
+    for (auto x = 0u; x < width; ++x) {
+      auto px = src[y * width + x];
+      auto real = is_bit_packed ? (px > 0.5f ? 1.f : 0.f) : px;
+      // The cost against an empty universe.
+      row_sum += get_pixel_cost(cuvk.mem_req, real, 0.f);
+      rv[(y + 1) * stride + x + 1] = rv[y * stride + x + 1] + row_sum;
     }
-
+  }
+  return rv;
+}
+// Sum of the real universe in `rect`, by its summed-area table.
+double sum_real_univ_rect(const std::vector<double>& integral, uint32_t width,
+  const Rect& rect) {
+  auto stride = width + 1;
+  auto x0 = rect.x;
+  auto y0 = rect.y;
+  auto x1 = rect.x + rect.width;
+  auto y1 = rect.y + rect.height;
+  return integral[y1 * stride + x1] - integral[y0 * stride + x1] -
+    integral[y1 * stride + x0] + integral[y0 * stride + x0];
+}
+// A real universe resident in one of the slots.
+struct RealUniverse {
+  uint32_t slot;
+  // Sum of pixels, by `sum_real_univ`.
+  float sum;
+  // Summed-area table, by `make_real_univ_integral`.
+  std::vector<double> integral;
+};
+// The real universe an invocation refers to; either a resident one or the one
+// sent along with the invocation.
+const BufferSlice& get_real_univ(const Cuvk& cuvk, CuvkRealUniverse real_univ) {
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  if (real_univ == nullptr) {
+    return allocs.dev_real_univ;
+  } else {
+    auto slot = reinterpret_cast<const RealUniverse*>(real_univ)->slot;
+    return allocs.real_univ_slots[slot];
+  }
+}
+// The pyramid of the real universe an invocation refers to.
+const BufferSlice& get_coarse_real_univ(const Cuvk& cuvk,
+  CuvkRealUniverse real_univ) {
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  if (real_univ == nullptr || cuvk.mem_req.coarseLevel == 0) {
+    return allocs.coarse_real_univ;
+  } else {
+    auto slot = reinterpret_cast<const RealUniverse*>(real_univ)->slot;
+    return allocs.coarse_real_univ_slots[slot];
+  }
+}
+// Build the pyramid of the real universe bound to `desc_set` into the pyramid
+// bound to it, level by level from the finest. The real universe must have been
+// written.
+void record_pyramid(L_INOUT CommandRecorder& rec, const Cuvk& cuvk,
+  const DescriptorSet& desc_set, const BufferSlice& pyramid) {
+  auto& scheduling = cuvk.pipes.cost_pipe.scheduling;
+  auto& downsample_pipes = cuvk.pipes.coarse_pipe.downsample_pipes;
+  for (auto i = 0u; i < downsample_pipes.size(); ++i) {
+    auto extent = get_level_extent(cuvk.mem_req, i + 1);
+    auto npx = extent.width * extent.height;
     rec
       // -----------------------------------------------------------------------
-      // Wait the costs to be computed and to be visible to host.
+      // Downsample the level below.
+      .dispatch(*downsample_pipes[i], &desc_set,
+        (npx + scheduling.npack_sec - 1) / scheduling.npack_sec, 1, 1)
       .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
-        .barrier(allocs.sim_univs,
-          VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_HOST_READ_BIT)
-        .barrier(allocs.partial_costs,
-          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
-      .to_stage(VK_PIPELINE_STAGE_HOST_BIT);
-    return rec.end();
+        .barrier(pyramid, VK_ACCESS_SHADER_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
   }
-  bool input(L_INOUT Task& task, const Invocation& invoke) {
-    auto& allocs = task.cuvk.allocs.evaluation_allocs;
-    if (invoke.pBacs != nullptr) {
-      if (!allocs.bacs.dev_mem_view().send(
-        invoke.pBacs, invoke.nBac * sizeof(Bacterium))) {
-        LOG.error("unable to send bacteria input");
-        return false;
-      }
-    }
-    if (invoke.pRealUniv != nullptr) {
-      if (!allocs.real_univ.dev_mem_view().send(
-        invoke.pRealUniv, invoke.width * invoke.height * sizeof(float))) {
-        LOG.error("unable to send real universe input");
-        return false;
-      }
-    }
-    return true;
+}
+// Copy the bacteria in input slot `slot`, and the real universe sent along at
+// `real_univ` unless it's `nullptr`, to device-local memory if evaluation
+// inputs are staged. Following commands can read them as if they were written
+// by host.
+void record_input_staging(L_INOUT CommandRecorder& rec, const Cuvk& cuvk,
+  uint32_t slot, uint32_t nbac, const BufferSlice* real_univ) {
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  if (!allocs.is_input_staged) { return; }
+  auto& bacs = allocs.bacs_slots[slot];
+  auto& dev_bacs = allocs.dev_bacs_slots[slot];
+  auto bacs_size = nbac * sizeof(Bacterium);
+  rec.from_stage(VK_PIPELINE_STAGE_HOST_BIT);
+  if (bacs_size > 0) {
+    rec.barrier(bacs.slice(0, bacs_size),
+      VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
   }
-  bool output(L_INOUT Task& task, const Invocation& invoke) {
-    auto& allocs = task.cuvk.allocs.evaluation_allocs;
-    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
-    if (invoke.pSimUnivs == nullptr) {
-      LOG.warning("the user application doesn't want the simulated universes");
-    } else {
-      if (!allocs.sim_univs.dev_mem_view().fetch(
-        invoke.pSimUnivs,
-        invoke.width * invoke.height * invoke.nSimUniv * sizeof(float))) {
-        LOG.error("unable to fetch simulated universes");
-        return false;
-      }
-    }
-    if (invoke.pCosts == nullptr) {
-      LOG.warning("the user application doesn't want the costs output");
-    } else {
-      auto nsec = scheduling.nsec_actual;
-      auto size = invoke.nSimUniv * nsec * sizeof(float);
-      auto mem = allocs.partial_costs.dev_mem_view().map(size);
-      if (mem == nullptr) {
-        LOG.error("unable to fetch costs output");
-        return false;
-      }
-      auto data = reinterpret_cast<const float*>(mem);
-      // Sum up the partial costs.
-      // TODO: (penguinliong) Test if it will be faster we do this on GPU?
-      auto univ = invoke.nSimUniv;
-      auto costs = reinterpret_cast<float*>(invoke.pCosts);
-      while (univ--) {
-        auto univ_offset = univ * nsec;
-        auto sec = nsec;
-        costs[univ] = 0.;
-        while (sec--) {
-          costs[univ] += data[sec + univ_offset];
-        }
-      }
-      allocs.partial_costs.dev_mem_view().unmap();
-    }
-    return true;
+  if (real_univ != nullptr) {
+    rec.barrier(*real_univ,
+      VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
   }
-  CuvkTaskStatus worker_main(Cuvk* cuvk, L_INOUT Task* task,
-    Invocation invoke) {
-    // Update descriptor set.
-    evaluation::write_desc_set(*task);
-
-    // Prepare for execution.
-    if (!evaluation::fill_cmd_buf(*task, invoke)) {
-      LOG.error("unable to fill command buffer for evaluation task");
-      return CUVK_TASK_STATUS_ERROR;
-    }
-    if (!task->fence.make()) {
-      return CUVK_TASK_STATUS_ERROR;
+  rec.to_stage(VK_PIPELINE_STAGE_TRANSFER_BIT);
+  if (bacs_size > 0) {
+    rec.copy_buf_to_buf(bacs.slice(0, bacs_size),
+      dev_bacs.slice(0, bacs_size));
+  }
+  if (real_univ != nullptr) {
+    rec.copy_buf_to_buf(*real_univ, allocs.dev_real_univ);
+  }
+  rec.from_stage(VK_PIPELINE_STAGE_TRANSFER_BIT);
+  if (bacs_size > 0) {
+    rec.barrier(dev_bacs.slice(0, bacs_size),
+      VK_ACCESS_TRANSFER_WRITE_BIT,
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+  }
+  if (real_univ != nullptr) {
+    rec.barrier(allocs.dev_real_univ,
+      VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+  }
+  rec.to_stage(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+// Offset of a resident real universe from the beginning of all resident real
+// universes, in words.
+uint32_t get_real_univ_frame(const Cuvk& cuvk, CuvkRealUniverse real_univ) {
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  auto slot = reinterpret_cast<const RealUniverse*>(real_univ)->slot;
+  auto offset = allocs.real_univ_slots[slot].offset - allocs.real_univs.offset;
+  return (uint32_t)(offset / sizeof(uint32_t));
+}
+// Sum up partial costs of each universe in `partial_costs`. `nsec` sections of
+// each universe are summed, and `bias` is added to each of the costs.
+bool sum_partial_costs(const Task& task, uint32_t nuniv, uint32_t nsec,
+  float bias, L_OUT float* costs) {
+  auto& allocs = task.cuvk.allocs.evaluation_allocs;
+  auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+  auto stride = scheduling.nsec_actual;
+  auto size = nuniv * stride * sizeof(float);
+  auto mem = allocs.partial_costs.dev_mem_view().map(size);
+  if (mem == nullptr) {
+    LOG.error("unable to fetch costs output");
+    return false;
+  }
+  auto data = reinterpret_cast<const float*>(mem);
+  auto univ = nuniv;
+  while (univ--) {
+    auto univ_offset = univ * stride;
+    auto sec = nsec;
+    costs[univ] = bias;
+    while (sec--) {
+      costs[univ] += data[sec + univ_offset];
     }
-    // Execute.
-    { // std::scoped_lock _(ctxt->submit_sync)
-      std::scoped_lock _(cuvk->submit_sync);
+  }
+  allocs.partial_costs.dev_mem_view().unmap();
+  return true;
+}
 
-      // Send input.
-      if (!input(*task, invoke)) {
-        return CUVK_TASK_STATUS_ERROR;
-      }
-      if (!task->exec.execute().submit(task->fence)) {
-        LOG.error("unable to submit command buffer");
-        return CUVK_TASK_STATUS_ERROR;
-      }
-      // TODO: (penguinliong) Remove this wait and move the output transfer to
-      // polling.
-      if (task->fence.wait() == FenceStatus::Error) {
-        LOG.error("unable to wait the fence");
-        return CUVK_TASK_STATUS_ERROR;
-      }
-      // Fetch output.
-      if (!output(*task, invoke)) {
-        return CUVK_TASK_STATUS_ERROR;
-      }
-    } // std::scoped_lock _(ctxt->submit_sync)
-    LOG.info("evaluation task is done");
-    return CUVK_TASK_STATUS_OK;
+// Copy the data in the staging buffer `real_univ` to device-only `dst`.
+bool upload_staged(const Cuvk& cuvk, const BufferSlice& dst) {
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  Executable exec(cuvk.ctxt, cuvk.ctxt.queues[0]);
+  Fence fence(cuvk.ctxt);
+  if (!exec.make() || !fence.make()) {
+    return false;
   }
-  bool check_params(const Invocation& invoke) {
-    // FIXME: (penguinliong) This check is not comprehensive.
-    if (invoke.nBac == 0) {
-      LOG.warning("number of bacteria is 0; eval did nothing");
-    }
+  auto rec = exec.record();
+  if (!rec.begin()) { return false; }
+  rec
+    .from_stage(VK_PIPELINE_STAGE_HOST_BIT)
+      .barrier(allocs.real_univ,
+        VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+    .to_stage(VK_PIPELINE_STAGE_TRANSFER_BIT)
+    .copy_buf_to_buf(allocs.real_univ, dst)
+    .from_stage(VK_PIPELINE_STAGE_TRANSFER_BIT)
+      .barrier(dst, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+    .to_stage(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+  if (!rec.end()) {
+    return false;
+  }
+  if (!exec.execute().submit(fence)) {
+    LOG.error("unable to submit command buffer");
+    return false;
+  }
+  if (fence.wait() == FenceStatus::Error) {
+    LOG.error("unable to wait the fence");
+    return false;
+  }
+  return true;
+}
+// Build the pyramid of resident real universe `real_univ` into `pyramid`.
+bool build_pyramid(const Cuvk& cuvk, const BufferSlice& real_univ,
+  const BufferSlice& pyramid) {
+  Executable exec(cuvk.ctxt, cuvk.ctxt.queues[0]);
+  DescriptorSet desc_set(cuvk.ctxt,
+    cuvk.pipes.cost_pipe.pipe_sec.desc_set_layout);
+  Fence fence(cuvk.ctxt);
+  if (!exec.make() || !desc_set.make() || !fence.make()) {
+    return false;
+  }
+  desc_set
+    .write(0, real_univ, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+    .write(15, pyramid, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  auto rec = exec.record();
+  if (!rec.begin()) { return false; }
+  record_pyramid(rec, cuvk, desc_set, pyramid);
+  if (!rec.end()) {
+    return false;
+  }
+  if (!exec.execute().submit(fence)) {
+    LOG.error("unable to submit command buffer");
+    return false;
+  }
+  if (fence.wait() == FenceStatus::Error) {
+    LOG.error("unable to wait the fence");
+    return false;
+  }
+  return true;
+}
+CuvkResult L_STDCALL cuvkCreateRealUniverse(
+  CuvkContext context,
+  const void* pRealUniv,
+  L_OUT CuvkRealUniverse* pRealUniverse) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  if (pRealUniv == nullptr) {
+    LOG.error("`pRealUniv` is `nullptr`");
+    return false;
+  }
+  auto& mem_req = cuvk->mem_req;
+  // The sum is needed for coverage mode. It's computed out of the lock.
+  auto sum = sum_real_univ(*cuvk, pRealUniv, mem_req.width, mem_req.height);
+  auto integral = make_real_univ_integral(*cuvk, pRealUniv,
+    mem_req.width, mem_req.height);
+
+  std::scoped_lock _(cuvk->submit_sync);
+  auto& used = cuvk->real_univ_slots_used;
+  auto it = std::find(used.begin(), used.end(), false);
+  if (it == used.end()) {
+    LOG.error("all {} real universe slots are in use", used.size());
+    return false;
+  }
+  auto slot = (uint32_t)(it - used.begin());
+  auto& dst = cuvk->allocs.evaluation_allocs.real_univ_slots[slot];
+  if (!send_real_univ(*cuvk, pRealUniv, mem_req.width, mem_req.height) ||
+    !upload_staged(*cuvk, dst)) {
+    LOG.error("unable to upload real universe");
+    return false;
+  }
+  // The pyramid for coarse-to-fine evaluation is built once here, rather than
+  // in each evaluation.
+  if (mem_req.coarseLevel != 0 && !build_pyramid(*cuvk, dst,
+    cuvk->allocs.evaluation_allocs.coarse_real_univ_slots[slot])) {
+    LOG.error("unable to build real universe pyramid");
+    return false;
+  }
+  *it = true;
+  *pRealUniverse = reinterpret_cast<CuvkRealUniverse>(
+    new RealUniverse { slot, sum, std::move(integral) });
+  return true;
+}
+void L_STDCALL cuvkDestroyRealUniverse(
+  CuvkContext context,
+  CuvkRealUniverse realUniverse) {
+  if (realUniverse == nullptr) {
+    return;
+  }
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  auto real_univ = reinterpret_cast<RealUniverse*>(realUniverse);
+  {
+    std::scoped_lock _(cuvk->submit_sync);
+    cuvk->real_univ_slots_used[real_univ->slot] = false;
+  }
+  delete real_univ;
+}
+CuvkResult L_STDCALL cuvkSetWeightMap(
+  CuvkContext context,
+  const void* pWeightMap) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  if (!cuvk->mem_req.useWeightMap) {
+    LOG.error("the context is not created with `useWeightMap`");
+    return false;
+  }
+  if (pWeightMap == nullptr) {
+    LOG.error("`pWeightMap` is `nullptr`");
+    return false;
+  }
+  auto& allocs = cuvk->allocs.evaluation_allocs;
+  // `weights` is rounded up for alignment. The padding is zeroed, as the last
+  // pack of 4 pixels in cost evaluation may reach into it.
+  std::vector<float> weights(allocs.weights.size / sizeof(float), 0.f);
+  std::memcpy(weights.data(), pWeightMap,
+    cuvk->mem_req.width * cuvk->mem_req.height * sizeof(float));
+
+  std::scoped_lock _(cuvk->submit_sync);
+  // The cost of the base universe was weighted by the previous weight map.
+  cuvk->has_base = false;
+  cuvk->has_weight_map = false;
+  if (!allocs.real_univ.dev_mem_view().send(weights.data(),
+    allocs.weights.size) || !upload_staged(*cuvk, allocs.weights)) {
+    LOG.error("unable to upload weight map");
+    return false;
+  }
+  cuvk->has_weight_map = true;
+  return true;
+}
+
+// Alignment of host memory allocations which makes them importable.
+size_t get_host_mem_align(const Cuvk& cuvk) {
+  auto align = cuvk.ctxt.req.phys_dev_info->min_imported_host_ptr_align;
+  return align > 0 ? static_cast<size_t>(align) : 4096;
+}
+CuvkResult L_STDCALL cuvkAllocHostMemory(
+  CuvkContext context,
+  CuvkSize size,
+  L_OUT void** ppMemory) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  auto align = get_host_mem_align(*cuvk);
+  // Imports are made in whole alignment units.
+  size_t aligned_size = (size + align - 1) / align * align;
+  if (aligned_size == 0) {
+    aligned_size = align;
+  }
+#ifdef _MSC_VER
+  auto mem = _aligned_malloc(aligned_size, align);
+#else
+  auto mem = std::aligned_alloc(align, aligned_size);
+#endif
+  if (mem == nullptr) {
+    LOG.error("unable to allocate host memory");
+    return false;
+  }
+  *ppMemory = mem;
+  return true;
+}
+void L_STDCALL cuvkFreeHostMemory(
+  CuvkContext context,
+  void* pMemory) {
+#ifdef _MSC_VER
+  _aligned_free(pMemory);
+#else
+  std::free(pMemory);
+#endif
+}
+
+CuvkResult L_STDCALL cuvkAllocHostBuffer(
+  CuvkContext context,
+  CuvkSize size,
+  L_OUT void** ppBuffer) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  // Buffers can't be empty.
+  auto buf_alloc = cuvk->allocs.heap_mgr.alloc_buf(std::max(size, 1u),
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    MemoryVisibility::HostVisible);
+  if (buf_alloc == nullptr) {
+    LOG.error("unable to allocate host buffer");
+    return false;
+  }
+  auto mapped = static_cast<char*>(buf_alloc->heap_alloc->mapped) +
+    buf_alloc->offset;
+  {
+    std::scoped_lock _(cuvk->host_buf_sync);
+    cuvk->host_bufs.emplace(mapped, buf_alloc);
+  }
+  *ppBuffer = mapped;
+  return true;
+}
+void L_STDCALL cuvkFreeHostBuffer(
+  CuvkContext context,
+  void* pBuffer) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  std::scoped_lock _(cuvk->host_buf_sync);
+  auto it = cuvk->host_bufs.find(static_cast<const char*>(pBuffer));
+  if (it == cuvk->host_bufs.end()) {
+    LOG.error("freeing unknown host buffer");
+    return;
+  }
+  cuvk->allocs.heap_mgr.free_buf(*it->second);
+  cuvk->host_bufs.erase(it);
+}
+
+void L_STDCALL cuvkQueryMemoryStats(
+  CuvkContext context,
+  L_OUT CuvkMemoryStats* pStats) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  auto& phys_dev_info = *cuvk->ctxt.req.phys_dev_info;
+  auto& heap_mgr = cuvk->allocs.heap_mgr;
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT pdmbp {};
+  pdmbp.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2KHR pdmp2 {};
+  pdmp2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+  pdmp2.pNext = &pdmbp;
+  if (phys_dev_info.has_mem_budget) {
+    phys_dev_info.get_mem_props2(phys_dev_info.phys_dev, &pdmp2);
+  } else {
+    vkGetPhysicalDeviceMemoryProperties(phys_dev_info.phys_dev,
+      &pdmp2.memoryProperties);
+  }
+  auto& pdmp = pdmp2.memoryProperties;
+
+  std::scoped_lock _(heap_mgr.sync);
+  pStats->nHeap = std::min<uint32_t>(pdmp.memoryHeapCount,
+    CUVK_MAX_MEMORY_HEAP_COUNT);
+  for (uint32_t i = 0; i < pStats->nHeap; ++i) {
+    auto& heap = pdmp.memoryHeaps[i];
+    auto& heap_stats = pStats->heaps[i];
+    heap_stats.size = heap.size;
+    heap_stats.deviceLocal =
+      (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    heap_stats.contextUsage = heap_mgr.statistics(i).reserved;
+    if (phys_dev_info.has_mem_budget) {
+      heap_stats.processUsage = pdmbp.heapUsage[i];
+      heap_stats.budget = pdmbp.heapBudget[i];
+    } else {
+      heap_stats.processUsage = heap_stats.contextUsage;
+      heap_stats.budget = heap.size;
+    }
+  }
+
+  auto& allocs = cuvk->allocs;
+  VkMemoryRequirements mr;
+  vkGetBufferMemoryRequirements(cuvk->ctxt.dev, allocs.hv_buf.buf, &mr);
+  pStats->breakdown.hostVisibleSize = mr.size;
+  vkGetBufferMemoryRequirements(cuvk->ctxt.dev, allocs.do_buf.buf, &mr);
+  pStats->breakdown.deviceOnlySize = mr.size;
+  pStats->breakdown.imageSize = 0;
+  for (auto img_alloc : {
+    &allocs.do_img, &allocs.base_img, &allocs.coarse_img,
+  }) {
+    vkGetImageMemoryRequirements(cuvk->ctxt.dev, img_alloc->img, &mr);
+    pStats->breakdown.imageSize += mr.size;
+  }
+  for (auto buf : allocs.growable_bufs()) {
+    if (buf->buf_alloc == nullptr) { continue; }
+    vkGetBufferMemoryRequirements(cuvk->ctxt.dev, buf->buf_alloc->buf, &mr);
+    if (buf->visibility == MemoryVisibility::HostVisible) {
+      pStats->breakdown.hostVisibleSize += mr.size;
+    } else {
+      pStats->breakdown.deviceOnlySize += mr.size;
+    }
+  }
+}
+
+namespace universe_fetch {
+  void record_fetch(L_INOUT CommandRecorder& rec, const Task& task,
+    uint32_t index) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& mem_req = task.cuvk.mem_req;
+    auto univ_size = get_sim_univ_size(mem_req);
+    auto img_slice = allocs.sim_univs_temp_entire.img_alloc->slice(index, 1);
+    auto buf_slice = allocs.sim_univs.slice(index * univ_size, univ_size);
+
+    if (mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT) {
+      auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+      std::array<uint32_t, 4> pack_meta {
+        scheduling.npack_univ,
+        mem_req.width,
+        mem_req.height,
+        index,
+      };
+      rec
+        // ---------------------------------------------------------------------
+        // Pack the rendered universe into bits. The universe is left in shader
+        // read-only layout by the evaluation task.
+        .push_const(task.cuvk.pipes.pack_pipe.pipe,
+          0, (uint32_t)pack_meta.size() * sizeof(uint32_t), pack_meta.data())
+        .dispatch(task.cuvk.pipes.pack_pipe.pipe, &task.desc_set,
+          1, scheduling.nsec_actual, 1)
+        .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+          .barrier(buf_slice,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+        .to_stage(VK_PIPELINE_STAGE_HOST_BIT);
+    } else {
+      rec
+        // ---------------------------------------------------------------------
+        // Copy the rendered universe out.
+        .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+          .barrier(img_slice,
+            VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+        .to_stage(VK_PIPELINE_STAGE_TRANSFER_BIT)
+        .copy_img_to_buf(img_slice, buf_slice)
+        .from_stage(VK_PIPELINE_STAGE_TRANSFER_BIT)
+          .barrier(buf_slice,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+          .barrier(img_slice,
+            VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+        .to_stage(VK_PIPELINE_STAGE_HOST_BIT |
+          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+  }
+  // Copy the rendered universes of `indices` out to their places in
+  // `sim_univs`.
+  bool fill_cmd_buf(L_INOUT Task& task, const std::vector<uint32_t>& indices) {
+    // The evaluation task might have bound the caller's memory, which is no
+    // longer imported.
+    task.desc_set.write(1, task.cuvk.allocs.evaluation_allocs.sim_univs,
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    auto rec = task.exec.record();
+    if (!rec.begin()) { return false; }
+    for (auto index : indices) {
+      record_fetch(rec, task, index);
+    }
+    return rec.end();
+  }
+}
+
+namespace evaluation {
+  using Invocation = CuvkEvaluationInvocation;
+
+  // Regions to be re-costed in incremental evaluation, or to be costed in
+  // evaluation with ROIs.
+  struct DirtyRegions {
+    // Bounding rectangle of dirty cells in each simulated universe.
+    std::vector<Rect> rects;
+    // Number of sections to be dispatched for each universe, enough to cover
+    // the largest rectangle.
+    uint32_t nsec;
+  };
+
+  bool is_incremental(const Invocation& invoke) {
+    return invoke.pDirtyBacs != nullptr;
+  }
+  bool has_roi(const Invocation& invoke) {
+    return invoke.pRois != nullptr;
+  }
+  // Region of interest of the `i`-th simulated universe, clamped to the
+  // universe.
+  Rect get_roi(const Invocation& invoke, uint32_t i) {
+    auto rois = reinterpret_cast<const Rect*>(invoke.pRois);
+    auto roi = rois[invoke.nRoi == 1 ? 0 : i];
+    auto x0 = std::min(roi.x, invoke.width);
+    auto y0 = std::min(roi.y, invoke.height);
+    // Extents are compared against the room left so that huge ones can't wrap
+    // around.
+    auto x1 = roi.width > invoke.width - x0 ? invoke.width : x0 + roi.width;
+    auto y1 = roi.height > invoke.height - y0 ? invoke.height : y0 + roi.height;
+    return { x0, y0, x1 - x0, y1 - y0 };
+  }
+  // Bounding rectangle of all regions of interest.
+  VkRect2D get_roi_bound(const Invocation& invoke) {
+    auto x0 = invoke.width;
+    auto y0 = invoke.height;
+    auto x1 = 0u;
+    auto y1 = 0u;
+    for (auto i = 0u; i < invoke.nRoi; ++i) {
+      auto roi = get_roi(invoke, i);
+      if (roi.width == 0 || roi.height == 0) { continue; }
+      x0 = std::min(x0, roi.x);
+      y0 = std::min(y0, roi.y);
+      x1 = std::max(x1, roi.x + roi.width);
+      y1 = std::max(y1, roi.y + roi.height);
+    }
+    if (x0 >= x1 || y0 >= y1) {
+      return VkRect2D {};
+    }
+    return VkRect2D {
+      { (int32_t)x0, (int32_t)y0 },
+      { x1 - x0, y1 - y0 },
+    };
+  }
+  // Each simulated universe is compared against its own real universe in
+  // multi-frame evaluation.
+  bool is_multi_frame(const Invocation& invoke) {
+    return invoke.pRealUnivs != nullptr;
+  }
+  // Whether the real universe is sent along with the invocation, rather than
+  // being resident.
+  bool is_real_univ_sent(const Invocation& invoke) {
+    return !is_multi_frame(invoke) && invoke.realUniv == nullptr;
+  }
+  // The real universe buffer bound to the shaders. All resident real universes
+  // are bound in multi-frame evaluation, and are indexed by `univ_frames`. The
+  // real universe sent along at `real_univ` is read as is, unless inputs are
+  // staged.
+  const BufferSlice& get_bound_real_univ(const Cuvk& cuvk,
+    const Invocation& invoke, const ImportedBuffer& real_univ) {
+    auto& allocs = cuvk.allocs.evaluation_allocs;
+    if (is_multi_frame(invoke)) {
+      return allocs.real_univs;
+    }
+    if (is_real_univ_sent(invoke) && !allocs.is_input_staged) {
+      return real_univ.slice;
+    }
+    return get_real_univ(cuvk, invoke.realUniv);
+  }
+  // Word offsets of the real universe of each simulated universe.
+  std::vector<uint32_t> make_univ_frames(const Cuvk& cuvk,
+    const Invocation& invoke) {
+    std::vector<uint32_t> rv(invoke.nSimUniv, 0);
+    if (is_multi_frame(invoke)) {
+      for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+        rv[i] = get_real_univ_frame(cuvk, invoke.pRealUnivs[i]);
+      }
+    }
+    return rv;
+  }
+  // Sum of the real universe of each simulated universe. Only used in coverage
+  // mode.
+  std::vector<float> make_real_sums(const Cuvk& cuvk,
+    const Invocation& invoke) {
+    if (is_multi_frame(invoke)) {
+      std::vector<float> rv;
+      rv.reserve(invoke.nSimUniv);
+      for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+        rv.push_back(
+          reinterpret_cast<const RealUniverse*>(invoke.pRealUnivs[i])->sum);
+      }
+      return rv;
+    }
+    auto sum = invoke.realUniv != nullptr ?
+      reinterpret_cast<const RealUniverse*>(invoke.realUniv)->sum :
+      sum_real_univ(cuvk, invoke.pRealUniv, invoke.width, invoke.height);
+    return std::vector<float>(invoke.nSimUniv, sum);
+  }
+  // Sum of the real universe out of the ROI of each simulated universe. Only
+  // used in evaluations with ROIs.
+  std::vector<float> make_out_of_roi_sums(const Cuvk& cuvk,
+    const Invocation& invoke) {
+    std::vector<double> temp_integral;
+    if (!is_multi_frame(invoke) && invoke.realUniv == nullptr) {
+      temp_integral = make_real_univ_integral(cuvk, invoke.pRealUniv,
+        invoke.width, invoke.height);
+    }
+    std::vector<float> rv;
+    rv.reserve(invoke.nSimUniv);
+    for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+      auto real_univ = is_multi_frame(invoke) ?
+        invoke.pRealUnivs[i] : invoke.realUniv;
+      auto& integral = real_univ == nullptr ? temp_integral :
+        reinterpret_cast<const RealUniverse*>(real_univ)->integral;
+      Rect entire { 0, 0, invoke.width, invoke.height };
+      auto total = sum_real_univ_rect(integral, invoke.width, entire);
+      auto in_roi = sum_real_univ_rect(integral, invoke.width,
+        get_roi(invoke, i));
+      rv.push_back((float)(total - in_roi));
+    }
+    return rv;
+  }
+  // Costs are accumulated while drawing in coverage mode. Incremental
+  // evaluations and evaluations with ROIs still compute costs in rectangular
+  // regions only.
+  bool is_coverage(const Cuvk& cuvk, const Invocation& invoke) {
+    return cuvk.mem_req.costMode == CUVK_COST_MODE_COVERAGE &&
+      !is_incremental(invoke) && !has_roi(invoke);
+  }
+  // All simulated universes are costed at a coarse resolution first, and only
+  // the promising ones are refined.
+  bool is_coarse_to_fine(const Cuvk& cuvk, const Invocation& invoke) {
+    return cuvk.mem_req.coarseLevel != 0 &&
+      (invoke.refineRatio > 0.f || invoke.refineBound > 0.f);
+  }
+  // Only the universes of the lowest costs are output.
+  bool is_top_k(const Invocation& invoke) {
+    return invoke.topK != 0;
+  }
+  // Universes of costs over the threshold are rejected.
+  bool has_threshold(const Invocation& invoke) {
+    return invoke.costThreshold > 0.f;
+  }
+  // Report the universes of costs over the threshold as rejected.
+  void reject_costs(const Invocation& invoke, uint32_t ncost,
+    L_INOUT float* costs) {
+    if (!has_threshold(invoke)) { return; }
+    for (auto i = 0u; i < ncost; ++i) {
+      if (costs[i] > invoke.costThreshold) {
+        costs[i] = std::numeric_limits<float>::infinity();
+      }
+    }
+  }
+  // Number of sections to be dispatched to cover `area` pixels.
+  uint32_t get_region_nsec(const Cuvk& cuvk, uint32_t area) {
+    // Each invocation covers 4 pixels in average, as `cost.comp` does.
+    auto& scheduling = cuvk.pipes.cost_pipe.scheduling;
+    auto npx_sec = 4 * scheduling.npack_sec;
+    return std::min((area + npx_sec - 1) / npx_sec, scheduling.nsec_actual);
+  }
+  DirtyRegions make_dirty_regions(const Cuvk& cuvk, const Invocation& invoke) {
+    DirtyRegions rv { std::vector<Rect>(invoke.nSimUniv, Rect {}), 0 };
+    if (has_roi(invoke)) {
+      uint32_t max_area = 0;
+      for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+        auto& rect = rv.rects[i];
+        rect = get_roi(invoke, i);
+        max_area = std::max(max_area, rect.width * rect.height);
+      }
+      rv.nsec = get_region_nsec(cuvk, max_area);
+      return rv;
+    }
+    if (!is_incremental(invoke)) {
+      return rv;
+    }
+    // Bounds in normalized device coordinates, in (left, top, right, bottom).
+    std::vector<std::array<float, 4>> bounds(invoke.nSimUniv, {
+      std::numeric_limits<float>::infinity(),
+      std::numeric_limits<float>::infinity(),
+      -std::numeric_limits<float>::infinity(),
+      -std::numeric_limits<float>::infinity(),
+    });
+    auto ratio = (float)invoke.width / (float)invoke.height;
+    auto bacs = reinterpret_cast<const Bacterium*>(invoke.pDirtyBacs);
+    for (auto i = 0u; i < invoke.nDirtyBac; ++i) {
+      auto& bac = bacs[i];
+      if (bac.univ < invoke.baseUniv ||
+        bac.univ - invoke.baseUniv >= invoke.nSimUniv) {
+        LOG.warning("dirty bacterium is in universe {} which is not evaluated",
+          bac.univ);
+        continue;
+      }
+      // Half extents of the capsule's bounding box. See `eval.geom`.
+      auto len = bac.size[0];
+      auto r = bac.size[1];
+      auto hx = (std::abs(std::cos(bac.orient)) * len + r) / ratio;
+      auto hy = std::abs(std::sin(bac.orient)) * len + r;
+      auto x = bac.pos[0] / ratio;
+      auto y = bac.pos[1];
+      auto& bound = bounds[bac.univ - invoke.baseUniv];
+      bound[0] = std::min(bound[0], x - hx);
+      bound[1] = std::min(bound[1], y - hy);
+      bound[2] = std::max(bound[2], x + hx);
+      bound[3] = std::max(bound[3], y + hy);
+    }
+    // Convert bounds to pixels. One more pixel is taken at each side, in case
+    // of any rasterization disagreement.
+    auto to_px = [](float ndc, uint32_t extent, float margin) {
+      auto px = std::floor((ndc + 1.f) * 0.5f * extent + margin);
+      return (uint32_t)std::clamp(px, 0.f, (float)extent);
+    };
+    uint32_t max_area = 0;
+    for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+      auto& bound = bounds[i];
+      if (bound[0] > bound[2]) { continue; }
+      auto x0 = to_px(bound[0], invoke.width, -1.f);
+      auto y0 = to_px(bound[1], invoke.height, -1.f);
+      auto x1 = to_px(bound[2], invoke.width, 2.f);
+      auto y1 = to_px(bound[3], invoke.height, 2.f);
+      auto& rect = rv.rects[i];
+      rect = { x0, y0, x1 - x0, y1 - y0 };
+      max_area = std::max(max_area, rect.width * rect.height);
+    }
+    rv.nsec = get_region_nsec(cuvk, max_area);
+    return rv;
+  }
+
+  // The real universe sent along with an invocation, used in place if it can be
+  // imported and the device reads it as is. Bit-packed real universes are
+  // packed on host, so they are always sent through the staging buffer.
+  ImportedBuffer import_real_univ(Cuvk& cuvk, const Invocation& invoke) {
+    auto is_bit_packed =
+      cuvk.mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT;
+    return ImportedBuffer(cuvk,
+      is_real_univ_sent(invoke) && !is_bit_packed ? invoke.pRealUniv : nullptr,
+      invoke.width * invoke.height * sizeof(float),
+      cuvk.allocs.evaluation_allocs.real_univ);
+  }
+  // Buffers an evaluation chunk works on. The rendered universes and costs are
+  // written to the caller's memory in place if it can be imported. Top-K
+  // selection and coarse-to-fine evaluation process the outputs on device
+  // before they are output, so they always use the staging buffers.
+  struct Buffers {
+    // Shared by all chunks of an invocation.
+    const ImportedBuffer& real_univ;
+    ImportedBuffer sim_univs;
+    ImportedBuffer costs;
+
+    Buffers(Cuvk& cuvk, const Invocation& invoke,
+      const ImportedBuffer& real_univ) :
+      real_univ(real_univ),
+      sim_univs(cuvk, is_top_k(invoke) ? nullptr : invoke.pSimUnivs,
+        invoke.nSimUniv * get_sim_univ_size(cuvk.mem_req),
+        cuvk.allocs.evaluation_allocs.sim_univs),
+      costs(cuvk,
+        is_top_k(invoke) || is_coarse_to_fine(cuvk, invoke) ?
+          nullptr : invoke.pCosts,
+        invoke.nSimUniv * sizeof(float),
+        cuvk.allocs.evaluation_allocs.univ_costs) {}
+  };
+
+  // Bacteria are bound from input slot `slot`.
+  void write_desc_set(L_INOUT Task& task, const Invocation& invoke,
+    const Buffers& bufs, uint32_t slot) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& sampler = task.cuvk.pipes.sampler;
+    task.desc_set
+      .write(0, get_bound_real_univ(task.cuvk, invoke, bufs.real_univ),
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(1, bufs.sim_univs.slice, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(3, allocs.partial_costs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(4, allocs.sim_univs_temp_view, sampler,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+      .write(5, allocs.base_univ, sampler,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+      .write(6, allocs.dirty_rects, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(7, allocs.cover_mask, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(8, allocs.cover_costs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(9, allocs.dev_bacs_slots[slot],
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(10, allocs.sorted_bacs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(11, allocs.univ_counts, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(12, allocs.univ_offsets, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(13, allocs.draw_cmds, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(14, allocs.univ_frames, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(15, get_coarse_real_univ(task.cuvk, invoke.realUniv),
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(16, allocs.coarse_univ_view, sampler,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+      .write(17, bufs.costs.slice, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(18, allocs.top_univs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(19, allocs.univ_running, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(20, allocs.partial_unions, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(21, allocs.weights, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  }
+  // Bucket bacteria in input slot `slot` by universe and make draw commands for
+  // each framebuffer. The bacteria must have been uploaded by `upload`.
+  void record_bucketing(L_INOUT CommandRecorder& rec, const Task& task,
+    const Invocation& invoke, uint32_t slot) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& limits = task.cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
+    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+    auto& bucket_pipe = task.cuvk.pipes.bucket_pipe;
+    // Bacteria are bucketed by universe on device, so they don't have to be
+    // sorted by the user application. Bacteria not in the simulated universes
+    // are dropped.
+    std::array<uint32_t, 4> bucket_meta {
+      invoke.nBac,
+      invoke.baseUniv,
+      invoke.nSimUniv,
+      limits.maxFramebufferLayers,
+    };
+    auto nbac_grp = (invoke.nBac + scheduling.npack_sec - 1) /
+      scheduling.npack_sec;
+    rec
+      // -----------------------------------------------------------------------
+      // Wait for bacteria data to be written, and clear the counters.
+      .fill_buf(allocs.univ_counts, 0)
+      .from_stage(VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+        .barrier(allocs.dev_bacs_slots[slot],
+          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(allocs.univ_counts, VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        .barrier(allocs.univ_frames,
+          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT)
+      // -----------------------------------------------------------------------
+      // Count bacteria in each universe. The bucketing pipelines share the
+      // pipeline layout, so push constants are pushed only once.
+      .push_const(bucket_pipe.count_pipe,
+        0, (uint32_t)bucket_meta.size() * sizeof(uint32_t), bucket_meta.data())
+      .dispatch(bucket_pipe.count_pipe, &task.desc_set, nbac_grp, 1, 1)
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.univ_counts, VK_ACCESS_SHADER_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      // -----------------------------------------------------------------------
+      // Scan the counts into offsets and make draw commands.
+      .dispatch(bucket_pipe.scan_pipe, &task.desc_set, 1, 1, 1)
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.univ_counts, VK_ACCESS_SHADER_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      // -----------------------------------------------------------------------
+      // Scatter bacteria to their buckets.
+      .dispatch(bucket_pipe.scatter_pipe, &task.desc_set, nbac_grp, 1, 1)
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.sorted_bacs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT)
+        .barrier(allocs.draw_cmds,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)
+      .to_stage(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+  }
+  // Sum up `nsec` partial costs of each universe, or the fixed-point costs in
+  // coverage mode, onto the biases in `univ_costs`. Partial unions are taken
+  // into account in IoU and Dice metrics.
+  void record_reduction(L_INOUT CommandRecorder& rec, const Task& task,
+    const Buffers& bufs, uint32_t nuniv, uint32_t nsec, bool coverage) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+    auto& reduce_pipe = task.cuvk.pipes.reduce_pipe.pipe;
+    std::array<uint32_t, 4> reduce_meta {
+      nuniv,
+      nsec,
+      scheduling.nsec_actual,
+      coverage ? 1u : 0u,
+    };
+    rec
+      // -----------------------------------------------------------------------
+      // Sum up the costs of each universe onto their biases.
+      .from_stage(VK_PIPELINE_STAGE_HOST_BIT |
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.partial_costs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(allocs.partial_unions,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(allocs.cover_costs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(bufs.costs.slice,
+          VK_ACCESS_HOST_WRITE_BIT,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      .push_const(reduce_pipe,
+        0, (uint32_t)reduce_meta.size() * sizeof(uint32_t), reduce_meta.data())
+      .dispatch(reduce_pipe, &task.desc_set,
+        (nuniv + scheduling.npack_sec - 1) / scheduling.npack_sec, 1, 1);
+  }
+  bool fill_cmd_buf(L_INOUT Task& task, const Invocation& invoke,
+    const Buffers& bufs, const DirtyRegions& regions, uint32_t slot) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+
+    auto rec = task.exec.record();
+    if (!rec.begin()) { return false; }
+
+    auto& limits = task.cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
+    auto is_bit_packed =
+      task.cuvk.mem_req.simUnivFormat == CUVK_SIM_UNIV_FORMAT_BIT;
+    auto coverage = is_coverage(task.cuvk, invoke);
+
+    // Only the first two fields are used by the evaluation pipeline. The rest
+    // are for the coverage pipeline.
+    struct {
+      uint32_t base_univ; // This will be added with `invoke` for multiple times.
+      float ratio;
+      uint32_t cost_offset;
+      uint32_t width;
+      uint32_t nword_univ;
+      uint32_t format;
+    } eval_meta {
+      invoke.baseUniv,
+      (float)invoke.width / (float)invoke.height,
+      0,
+      invoke.width,
+      get_univ_nword(task.cuvk.mem_req),
+      (uint32_t)task.cuvk.mem_req.simUnivFormat,
+    };
+    auto& graph_pipe = coverage ?
+      task.cuvk.pipes.cover_pipe.pipe : task.cuvk.pipes.eval_pipe.pipe;
+    VkShaderStageFlags eval_meta_stages = coverage ?
+      VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT :
+      VK_SHADER_STAGE_GEOMETRY_BIT;
+    uint32_t eval_meta_size = coverage ? sizeof(eval_meta) : 8;
+
+    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+    record_bucketing(rec, task, invoke, slot);
+    if (coverage) {
+      rec
+        // ---------------------------------------------------------------------
+        // Clear the coverage bitmask and costs.
+        .fill_buf(allocs.cover_mask, 0)
+        .fill_buf(allocs.cover_costs, 0)
+        .from_stage(VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+          .barrier(get_bound_real_univ(task.cuvk, invoke, bufs.real_univ),
+            VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+          .barrier(allocs.cover_mask, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+          .barrier(allocs.cover_costs, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+        .to_stage(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    // The number of universes that can be simulated is limited by the number
+    // of layers that can be shoved into a single framebuffer.
+    uint32_t ngrp = (invoke.nSimUniv + limits.maxFramebufferLayers - 1)
+      / limits.maxFramebufferLayers;
+    for (auto i = 0u; i < ngrp; ++i) {
+      auto& img_view = allocs.sim_univs_temps[i];
+      auto& framebuf = allocs.sim_univs_temp_framebufs[i];
+      auto draw_cmd = allocs.draw_cmds.slice(
+        i * sizeof(VkDrawIndirectCommand), sizeof(VkDrawIndirectCommand));
+      rec
+        // ---------------------------------------------------------------------
+        // Rearrange simulated universes output layout.
+        .from_stage(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
+          .barrier(img_view,
+            0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+        .to_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+        // ---------------------------------------------------------------------
+        // Draw simulated cell universes.
+        .push_const(graph_pipe, eval_meta_stages,
+          0, eval_meta_size, &eval_meta)
+        .draw_indirect(graph_pipe,
+          coverage ?
+            std::make_optional<const DescriptorSet*>(&task.desc_set) :
+            std::nullopt,
+          allocs.sorted_bacs, draw_cmd, framebuf,
+          has_roi(invoke) ?
+            std::make_optional(get_roi_bound(invoke)) : std::nullopt);
+
+      // Update states.
+      eval_meta.base_univ += limits.maxFramebufferLayers;
+      eval_meta.cost_offset += limits.maxFramebufferLayers;
+    }
+    auto sim_univs_temps = allocs.sim_univs_temp_entire.img_alloc->slice(
+      0, invoke.nSimUniv);
+    // Simulated universes are only copied out on request. Costs are computed
+    // from the rendered images directly. In top-K selection only the selected
+    // universes are copied out, after the selection is done.
+    auto fetch_sim_univs = invoke.pSimUnivs != nullptr && !is_top_k(invoke);
+
+    if (fetch_sim_univs && !is_bit_packed) {
+      rec
+        // ---------------------------------------------------------------------
+        // Wait for the simulated universes to be drawn.
+        .from_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+          .barrier(sim_univs_temps,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+        .to_stage(VK_PIPELINE_STAGE_TRANSFER_BIT);
+      // -----------------------------------------------------------------------
+      // Copy the simulated universes out.
+      // TODO: (penguinliong) Use another queue for copy in the future.
+      if (has_roi(invoke)) {
+        auto rect = get_roi_bound(invoke);
+        auto texel_size = get_sim_univ_size(task.cuvk.mem_req) /
+          (invoke.width * invoke.height);
+        // Buffer offsets of copies must be multiples of 4, so the copy starts
+        // from an aligned row if it doesn't.
+        auto px_offset = rect.offset.y * invoke.width + rect.offset.x;
+        if (px_offset * texel_size % 4 != 0) {
+          auto y1 = rect.offset.y + rect.extent.height;
+          rect.offset = { 0, rect.offset.y - rect.offset.y % 4 };
+          rect.extent = { invoke.width, y1 - rect.offset.y };
+          px_offset = rect.offset.y * invoke.width;
+        }
+        auto& sim_univs = bufs.sim_univs.slice;
+        auto dst = sim_univs.slice(px_offset * texel_size,
+          sim_univs.size - px_offset * texel_size);
+        if (rect.extent.width != 0) {
+          rec.copy_img_to_buf(sim_univs_temps, dst, rect);
+        }
+      } else {
+        rec.copy_img_to_buf(sim_univs_temps, bufs.sim_univs.slice);
+      }
+    }
+    rec
+      // -----------------------------------------------------------------------
+      // Wait for the simulated universes to be sampled.
+      .from_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_TRANSFER_BIT)
+        .barrier(sim_univs_temps,
+          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+          VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    if (fetch_sim_univs && is_bit_packed) {
+      std::array<uint32_t, 4> pack_meta {
+        scheduling.npack_univ,
+        invoke.width,
+        invoke.height,
+        0, // base universe
+      };
+      rec
+        // ---------------------------------------------------------------------
+        // Pack the simulated universes into bits.
+        .push_const(task.cuvk.pipes.pack_pipe.pipe,
+          0, (uint32_t)pack_meta.size() * sizeof(uint32_t), pack_meta.data())
+        .dispatch(task.cuvk.pipes.pack_pipe.pipe, &task.desc_set,
+          invoke.nSimUniv, scheduling.nsec_actual, 1);
+    }
+
+    if (is_incremental(invoke) || has_roi(invoke)) {
+      std::array<uint32_t, 4> delta_meta {
+        scheduling.nsec_actual,
+        invoke.width,
+        // Only the simulated universes are costed in ROIs.
+        is_incremental(invoke) ? 1u : 0u,
+        0,
+      };
+      rec
+        .from_stage(VK_PIPELINE_STAGE_HOST_BIT)
+          .barrier(allocs.dirty_rects,
+            VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      if (regions.nsec != 0) {
+        rec
+          // -------------------------------------------------------------------
+          // Dispatch delta cost computation in dirty regions or ROIs.
+          .push_const(task.cuvk.pipes.delta_pipe.pipe,
+            0, (uint32_t)delta_meta.size() * sizeof(uint32_t),
+            delta_meta.data())
+          .dispatch(task.cuvk.pipes.delta_pipe.pipe, &task.desc_set,
+            invoke.nSimUniv, regions.nsec, 1);
+      }
+    } else if (!coverage) {
+      if (has_threshold(invoke)) {
+        rec
+          // -------------------------------------------------------------------
+          // Clear the running costs of early rejection.
+          .fill_buf(allocs.univ_running, 0)
+          .from_stage(VK_PIPELINE_STAGE_TRANSFER_BIT)
+            .barrier(allocs.univ_running, VK_ACCESS_TRANSFER_WRITE_BIT,
+              VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+          .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      }
+      if (scheduling.nsec != 0) {
+        CuvkCostPipeline::CostMeta cost_meta {
+          scheduling.nsec_actual,
+          scheduling.npack_sec,
+          scheduling.npack_univ,
+          0,
+          invoke.costThreshold,
+        };
+        rec
+          // -------------------------------------------------------------------
+          // Dispatch cost computation.
+          .push_const(task.cuvk.pipes.cost_pipe.pipe_sec,
+            0, sizeof(cost_meta), &cost_meta)
+          .dispatch(task.cuvk.pipes.cost_pipe.pipe_sec, &task.desc_set,
+            invoke.nSimUniv, scheduling.nsec, 1);
+      }
+      if (scheduling.npack_res != 0) {
+        CuvkCostPipeline::CostMeta cost_meta {
+          scheduling.nsec_actual,
+          scheduling.npack_res,
+          scheduling.npack_univ,
+          scheduling.nsec,
+          invoke.costThreshold,
+        };
+        rec
+          // -------------------------------------------------------------------
+          // Dispatch cost computation for residuals.
+          .push_const(task.cuvk.pipes.cost_pipe.pipe_res,
+            0, sizeof(cost_meta), &cost_meta)
+          .dispatch(task.cuvk.pipes.cost_pipe.pipe_res, &task.desc_set,
+            invoke.nSimUniv, 1, 1);
+      }
+    }
+
+    record_reduction(rec, task, bufs, invoke.nSimUniv,
+      is_incremental(invoke) || has_roi(invoke) ?
+        regions.nsec : scheduling.nsec_actual,
+      coverage);
+    if (is_top_k(invoke)) {
+      std::array<uint32_t, 4> topk_meta { invoke.nSimUniv, invoke.topK, 0, 0 };
+      rec
+        // ---------------------------------------------------------------------
+        // Select the universes of the lowest costs.
+        .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+          .barrier(bufs.costs.slice,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .push_const(task.cuvk.pipes.topk_pipe.pipe,
+          0, (uint32_t)topk_meta.size() * sizeof(uint32_t), topk_meta.data())
+        .dispatch(task.cuvk.pipes.topk_pipe.pipe, &task.desc_set,
+          (invoke.nSimUniv + scheduling.npack_sec - 1) / scheduling.npack_sec,
+          1, 1);
+    }
+
+    rec
+      // -----------------------------------------------------------------------
+      // Wait the outputs to be visible to host.
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+        VK_PIPELINE_STAGE_TRANSFER_BIT)
+        .barrier(bufs.costs.slice,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    if (is_top_k(invoke)) {
+      rec
+        .barrier(allocs.top_univs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT);
+    }
+    if (fetch_sim_univs) {
+      rec
+        .barrier(bufs.sim_univs.slice,
+          VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+          VK_ACCESS_HOST_READ_BIT);
+    }
+    rec
+      .to_stage(VK_PIPELINE_STAGE_HOST_BIT);
+    return rec.end();
+  }
+  // Draw and cost all simulated universes at the coarse resolution. The costs
+  // are reduced from `nsec` sections into `univ_costs`. The universes to be
+  // refined are then selected into `top_univs`, and the bacteria in them are
+  // renumbered in place for the fine pass.
+  bool fill_coarse_cmd_buf(L_INOUT Task& task, const Invocation& invoke,
+    const Buffers& bufs, uint32_t nsec) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& limits = task.cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
+    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+    auto& coarse_pipe = task.cuvk.pipes.coarse_pipe;
+    auto& eval_pipe = task.cuvk.pipes.eval_pipe.pipe;
+    auto& refine_pipe = task.cuvk.pipes.topk_pipe.refine_pipe;
+
+    auto rec = task.exec.record();
+    if (!rec.begin()) { return false; }
+
+    record_bucketing(rec, task, invoke, 0);
+    // Resident real universes have their pyramids built on registration. Only
+    // the one sent along is downsampled here.
+    if (invoke.realUniv == nullptr) {
+      rec
+        .from_stage(VK_PIPELINE_STAGE_HOST_BIT)
+          .barrier(get_bound_real_univ(task.cuvk, invoke, bufs.real_univ),
+            VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+      record_pyramid(rec, task.cuvk, task.desc_set, allocs.coarse_real_univ);
+    }
+
+    struct {
+      uint32_t base_univ;
+      float ratio;
+    } eval_meta {
+      invoke.baseUniv,
+      (float)invoke.width / (float)invoke.height,
+    };
+    uint32_t ngrp = (invoke.nSimUniv + limits.maxFramebufferLayers - 1)
+      / limits.maxFramebufferLayers;
+    for (auto i = 0u; i < ngrp; ++i) {
+      auto draw_cmd = allocs.draw_cmds.slice(
+        i * sizeof(VkDrawIndirectCommand), sizeof(VkDrawIndirectCommand));
+      rec
+        // ---------------------------------------------------------------------
+        // Draw coarse universes. The viewport follows the framebuffer so the
+        // evaluation pipeline is reused.
+        .from_stage(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
+          .barrier(allocs.coarse_univs[i],
+            0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+        .to_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+        .push_const(eval_pipe, VK_SHADER_STAGE_GEOMETRY_BIT,
+          0, sizeof(eval_meta), &eval_meta)
+        .draw_indirect(eval_pipe, std::nullopt, allocs.sorted_bacs, draw_cmd,
+          allocs.coarse_univ_framebufs[i], std::nullopt);
+
+      eval_meta.base_univ += limits.maxFramebufferLayers;
+    }
+
+    auto coarse_univs = allocs.coarse_univ_view.img_slice.img_alloc->slice(
+      0, invoke.nSimUniv);
+    std::array<uint32_t, 4> coarse_meta { scheduling.nsec_actual, 0, 0, 0 };
+    rec
+      // -----------------------------------------------------------------------
+      // Cost the coarse universes.
+      .from_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+        .barrier(coarse_univs,
+          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      .push_const(coarse_pipe.pipe,
+        0, (uint32_t)coarse_meta.size() * sizeof(uint32_t), coarse_meta.data())
+      .dispatch(coarse_pipe.pipe, &task.desc_set, invoke.nSimUniv, nsec, 1);
+    record_reduction(rec, task, bufs, invoke.nSimUniv, nsec, false);
+
+    // Coarse costs are compared against the bound at the full resolution. The
+    // scale is a power of 2, so the bound is scaled down exactly.
+    auto scale = get_coarse_scale(task.cuvk.mem_req);
+    struct {
+      uint32_t nuniv;
+      uint32_t nbest;
+      float bound;
+    } refine_meta {
+      invoke.nSimUniv,
+      (uint32_t)std::ceil(invoke.refineRatio * invoke.nSimUniv),
+      invoke.refineBound / (float)(scale * scale),
+    };
+    std::array<uint32_t, 3> compact_meta {
+      invoke.nBac,
+      invoke.baseUniv,
+      invoke.nSimUniv,
+    };
+    auto& dev_bacs = allocs.dev_bacs_slots[0];
+    rec
+      // -----------------------------------------------------------------------
+      // Select the universes to be refined.
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.univ_costs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(allocs.univ_counts,
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+          VK_ACCESS_SHADER_WRITE_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      .push_const(refine_pipe, 0, sizeof(refine_meta), &refine_meta)
+      .dispatch(refine_pipe, &task.desc_set,
+        (invoke.nSimUniv + scheduling.npack_sec - 1) / scheduling.npack_sec,
+        1, 1)
+      // -----------------------------------------------------------------------
+      // Renumber the bacteria in the selected universes. They have been
+      // bucketed, so they are no longer needed by the coarse pass.
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.univ_counts,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(dev_bacs,
+          VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      .push_const(coarse_pipe.compact_pipe,
+        0, (uint32_t)compact_meta.size() * sizeof(uint32_t),
+        compact_meta.data())
+      .dispatch(coarse_pipe.compact_pipe, &task.desc_set,
+        (invoke.nBac + scheduling.npack_sec - 1) / scheduling.npack_sec, 1, 1)
+      // -----------------------------------------------------------------------
+      // Wait the costs and the selection to be visible to host, and the
+      // bacteria to the fine pass.
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.univ_costs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+        .barrier(allocs.top_univs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+        .barrier(dev_bacs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+      .to_stage(VK_PIPELINE_STAGE_HOST_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    return rec.end();
+  }
+  // Send the bacteria to input slot `slot`, and the real universe to
+  // `real_univ` unless it's `nullptr`. Staged inputs are then copied to
+  // device-local memory in a submission of their own, so that the inputs of
+  // the next chunk are uploaded while the device is still working on the
+  // current one. Submissions made afterwards read the copies.
+  bool upload(L_INOUT Task& task, const Invocation& invoke, uint32_t slot,
+    const ImportedBuffer* real_univ) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    // Bacteria are never bound in place, even if they are in a host buffer.
+    // The slot is filled while the device is still working on the previous
+    // chunk, and the bacteria of a chunk are usually filtered out of the
+    // caller's memory anyway.
+    if (invoke.pBacs != nullptr) {
+      if (!allocs.bacs_slots[slot].dev_mem_view().send(
+        invoke.pBacs, invoke.nBac * sizeof(Bacterium))) {
+        LOG.error("unable to send bacteria input");
+        return false;
+      }
+    }
+    if (real_univ != nullptr) {
+      if (real_univ->is_in_place() ?
+        !real_univ->send(invoke.pRealUniv,
+          invoke.width * invoke.height * sizeof(float)) :
+        !send_real_univ(task.cuvk, invoke.pRealUniv,
+          invoke.width, invoke.height)) {
+        LOG.error("unable to send real universe input");
+        return false;
+      }
+    }
+    if (!allocs.is_input_staged) {
+      return true;
+    }
+    // The previous upload must be done before its command buffer is reused. It
+    // has been submitted if the fence is ever made.
+    if (task.upload_fence.fence != VK_NULL_HANDLE &&
+      task.upload_fence.wait() == FenceStatus::Error) {
+      LOG.error("unable to wait the fence");
+      return false;
+    }
+    if (!task.upload_exec.make() || !task.upload_fence.make()) {
+      return false;
+    }
+    auto rec = task.upload_exec.record();
+    if (!rec.begin()) { return false; }
+    record_input_staging(rec, task.cuvk, slot, invoke.nBac,
+      real_univ != nullptr ? &real_univ->slice : nullptr);
+    if (!rec.end()) {
+      LOG.error("unable to fill command buffer for input upload");
+      return false;
+    }
+    if (!task.upload_exec.execute().submit(task.upload_fence)) {
+      LOG.error("unable to submit input upload");
+      return false;
+    }
+    return true;
+  }
+  // Send the rest of the inputs. These are read only by the evaluation of the
+  // current chunk, so they are sent after the previous one is done.
+  bool input(L_INOUT Task& task, const Invocation& invoke,
+    const DirtyRegions& regions) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto univ_frames = make_univ_frames(task.cuvk, invoke);
+    if (!allocs.univ_frames.dev_mem_view().send(
+      univ_frames.data(), univ_frames.size() * sizeof(uint32_t))) {
+      LOG.error("unable to send real universe indices");
+      return false;
+    }
+    if (is_incremental(invoke) || has_roi(invoke)) {
+      if (!allocs.dirty_rects.dev_mem_view().send(
+        regions.rects.data(), regions.rects.size() * sizeof(Rect))) {
+        LOG.error("unable to send dirty regions");
+        return false;
+      }
+    }
+    return true;
+  }
+  // Costs are summed up on device onto their biases, which are the sums of the
+  // real universes in coverage mode, the sums out of ROIs in evaluation with
+  // ROIs, or the cost of the base universe in incremental evaluation.
+  bool send_univ_biases(const Invocation& invoke, const Buffers& bufs,
+    float base_cost, const std::vector<float>& biases) {
+    std::vector<float> univ_costs(invoke.nSimUniv,
+      is_incremental(invoke) ? base_cost : 0.f);
+    for (auto i = 0u; i < biases.size(); ++i) {
+      univ_costs[i] += biases[i];
+    }
+    // Biases are written in place of the costs, even if they are the caller's
+    // memory.
+    if (!bufs.costs.slice.dev_mem_view().send(
+      univ_costs.data(), univ_costs.size() * sizeof(float))) {
+      LOG.error("unable to send cost biases");
+      return false;
+    }
+    return true;
+  }
+  // Output the selected universes of top-K selection. Rendered universes are
+  // copied out in another submission as their indices are only known now.
+  bool output_top_k(L_INOUT Task& task, const Invocation& invoke) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    std::vector<TopUniverse> top_univs(invoke.topK);
+    if (!allocs.top_univs.dev_mem_view().fetch(
+      top_univs.data(), top_univs.size() * sizeof(TopUniverse))) {
+      LOG.error("unable to fetch selected universes");
+      return false;
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve(invoke.topK);
+    auto top_univ_ids = reinterpret_cast<uint32_t*>(invoke.pTopUnivs);
+    auto costs = reinterpret_cast<float*>(invoke.pCosts);
+    for (auto i = 0u; i < invoke.topK; ++i) {
+      indices.push_back(top_univs[i].univ);
+      top_univ_ids[i] = top_univs[i].univ;
+      if (costs != nullptr) {
+        costs[i] = top_univs[i].cost;
+      }
+    }
+    if (costs != nullptr) {
+      reject_costs(invoke, invoke.topK, costs);
+    }
+    if (invoke.pSimUnivs == nullptr) {
+      return true;
+    }
+
+    if (!task.exec.make() || !universe_fetch::fill_cmd_buf(task, indices)) {
+      LOG.error("unable to fill command buffer for universe fetch");
+      return false;
+    }
+    if (!task.fence.make()) {
+      return false;
+    }
+    if (!task.exec.execute().submit(task.fence)) {
+      LOG.error("unable to submit command buffer");
+      return false;
+    }
+    if (task.fence.wait() == FenceStatus::Error) {
+      LOG.error("unable to wait the fence");
+      return false;
+    }
+    auto univ_size = get_sim_univ_size(task.cuvk.mem_req);
+    auto dst = reinterpret_cast<uint8_t*>(invoke.pSimUnivs);
+    for (auto i = 0u; i < invoke.topK; ++i) {
+      if (!allocs.sim_univs.slice(indices[i] * univ_size, univ_size)
+        .dev_mem_view().fetch(dst + i * univ_size, univ_size)) {
+        LOG.error("unable to fetch simulated universes");
+        return false;
+      }
+    }
+    return true;
+  }
+  bool output(L_INOUT Task& task, const Invocation& invoke,
+    const Buffers& bufs) {
+    if (is_top_k(invoke)) {
+      return output_top_k(task, invoke);
+    }
+    if (invoke.pSimUnivs != nullptr) {
+      if (!bufs.sim_univs.fetch(
+        invoke.pSimUnivs,
+        invoke.nSimUniv * get_sim_univ_size(task.cuvk.mem_req))) {
+        LOG.error("unable to fetch simulated universes");
+        return false;
+      }
+    }
+    if (invoke.pCosts == nullptr) {
+      LOG.warning("the user application doesn't want the costs output");
+    } else {
+      auto costs = reinterpret_cast<float*>(invoke.pCosts);
+      if (!bufs.costs.fetch(costs, invoke.nSimUniv * sizeof(float))) {
+        LOG.error("unable to fetch costs output");
+        return false;
+      }
+      reject_costs(invoke, invoke.nSimUniv, costs);
+    }
+    return true;
+  }
+  // Evaluate all simulated universes at the coarse resolution, and then the
+  // selected ones at full resolution. Both passes are submitted in a row.
+  CuvkTaskStatus coarse_to_fine_main(Cuvk* cuvk, L_INOUT Task* task,
+    const Invocation& invoke) {
+    auto coarse_extent = get_coarse_extent(cuvk->mem_req);
+    auto coarse_nsec = get_region_nsec(*cuvk,
+      coarse_extent.width * coarse_extent.height);
+    auto regions = make_dirty_regions(*cuvk, invoke);
+    if (!task->fence.make()) {
+      return CUVK_TASK_STATUS_ERROR;
+    }
+    { // std::scoped_lock _(ctxt->submit_sync)
+      std::scoped_lock _(cuvk->submit_sync);
+
+      // Coarse-to-fine evaluation can't be split, so the buffers must grow to
+      // hold the entire invocation.
+      if (!cuvk->grow_eval_bufs(invoke.nBac, invoke.nSimUniv)) {
+        LOG.error("unable to allocate evaluation buffers for coarse-to-fine "
+          "evaluation");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      auto real_univ = import_real_univ(*cuvk, invoke);
+      Buffers bufs(*cuvk, invoke, real_univ);
+      evaluation::write_desc_set(*task, invoke, bufs, 0);
+      if (!fill_coarse_cmd_buf(*task, invoke, bufs, coarse_nsec)) {
+        LOG.error("unable to fill command buffer for coarse evaluation");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+
+      // Coarse pass.
+      if (!upload(*task, invoke, 0,
+        is_real_univ_sent(invoke) ? &real_univ : nullptr) ||
+        !input(*task, invoke, regions) ||
+        !send_univ_biases(invoke, bufs, 0.f, {})) {
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      if (!task->exec.execute().submit(task->fence)) {
+        LOG.error("unable to submit command buffer");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      ++cuvk->eval_gen;
+      if (task->fence.wait() == FenceStatus::Error) {
+        LOG.error("unable to wait the fence");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      // Coarse costs are scaled to the full resolution, and are the estimates
+      // of the universes not refined.
+      auto costs = reinterpret_cast<float*>(invoke.pCosts);
+      if (!cuvk->allocs.evaluation_allocs.univ_costs.dev_mem_view().fetch(
+        costs, invoke.nSimUniv * sizeof(float))) {
+        LOG.error("unable to fetch coarse costs");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      auto scale = get_coarse_scale(cuvk->mem_req);
+      for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+        costs[i] *= (float)(scale * scale);
+      }
+
+      // Fine pass. Refined universes are selected and their bacteria are
+      // renumbered on the device already; selected universes are a prefix of
+      // `top_univs`, in the order of their fine-pass IDs.
+      std::vector<TopUniverse> top_univs(invoke.nSimUniv);
+      if (!cuvk->allocs.evaluation_allocs.top_univs.dev_mem_view().fetch(
+        top_univs.data(), top_univs.size() * sizeof(TopUniverse))) {
+        LOG.error("unable to fetch refined universes");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      auto nrefined = (uint32_t)(std::find_if(top_univs.begin(),
+        top_univs.end(), [](const TopUniverse& x) {
+          return x.univ == std::numeric_limits<uint32_t>::max();
+        }) - top_univs.begin());
+      LOG.info("{} of {} universes are refined", nrefined, invoke.nSimUniv);
+      if (nrefined != 0) {
+        std::vector<float> fine_costs(nrefined);
+        auto fine_invoke = invoke;
+        fine_invoke.pBacs = nullptr;
+        fine_invoke.nSimUniv = nrefined;
+        fine_invoke.baseUniv = 0;
+        fine_invoke.pCosts = fine_costs.data();
+        fine_invoke.refineRatio = 0.f;
+        fine_invoke.refineBound = 0.f;
+        auto fine_regions = make_dirty_regions(*cuvk, fine_invoke);
+        std::vector<float> biases;
+        if (is_coverage(*cuvk, fine_invoke)) {
+          biases = make_real_sums(*cuvk, fine_invoke);
+        }
+        if (!task->exec.make() ||
+          !fill_cmd_buf(*task, fine_invoke, bufs, fine_regions, 0)) {
+          LOG.error("unable to fill command buffer for fine evaluation");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        if (!task->fence.make()) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        if (!input(*task, fine_invoke, fine_regions) ||
+          !send_univ_biases(fine_invoke, bufs, cuvk->base_cost, biases)) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        if (!task->exec.execute().submit(task->fence)) {
+          LOG.error("unable to submit command buffer");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        ++cuvk->eval_gen;
+        if (task->fence.wait() == FenceStatus::Error) {
+          LOG.error("unable to wait the fence");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        if (!output(*task, fine_invoke, bufs)) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        for (auto i = 0u; i < nrefined; ++i) {
+          costs[top_univs[i].univ] = fine_costs[i];
+        }
+      }
+      // Rendered universes are of the refined universes only, so they are not
+      // exposed for fetching.
+      task->eval_gen = cuvk->eval_gen;
+      task->nsim_univ = 0;
+    } // std::scoped_lock _(ctxt->submit_sync)
+    LOG.info("coarse-to-fine evaluation task is done");
+    return CUVK_TASK_STATUS_OK;
+  }
+  // Whether the simulated universes, or their bacteria, are more than a batch
+  // can hold even if evaluation buffers grow to their limits.
+  bool exceeds_batch(const Cuvk& cuvk, const Invocation& invoke) {
+    auto& limits = cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
+    return invoke.nSimUniv > cuvk.mem_req.nuniv ||
+      invoke.nBac > get_max_eval_nbac(limits, cuvk.mem_req);
+  }
+  // Simulated universes are split into chunks if they, or their bacteria, don't
+  // fit in the evaluation buffers. Must be called with `submit_sync` held.
+  bool needs_chunking(const Cuvk& cuvk, const Invocation& invoke) {
+    auto& allocs = cuvk.allocs.evaluation_allocs;
+    return invoke.nSimUniv > allocs.nuniv_cap ||
+      invoke.nBac > allocs.nbac_cap;
+  }
+  // Ranges of simulated universes of each chunk, in `(begin, end)`. Bacteria
+  // out of the simulated universes are not counted as they are dropped anyway.
+  // Returns an empty list if a single universe has too many bacteria.
+  std::vector<std::pair<uint32_t, uint32_t>> split_chunks(const Cuvk& cuvk,
+    const Invocation& invoke) {
+    std::vector<std::pair<uint32_t, uint32_t>> rv;
+    if (!needs_chunking(cuvk, invoke)) {
+      rv.emplace_back(0, invoke.nSimUniv);
+      return rv;
+    }
+    std::vector<uint32_t> counts(invoke.nSimUniv, 0);
+    auto bacs = reinterpret_cast<const Bacterium*>(invoke.pBacs);
+    for (auto i = 0u; i < invoke.nBac; ++i) {
+      auto univ = bacs[i].univ - invoke.baseUniv;
+      if (bacs[i].univ >= invoke.baseUniv && univ < invoke.nSimUniv) {
+        ++counts[univ];
+      }
+    }
+    auto& allocs = cuvk.allocs.evaluation_allocs;
+    uint32_t begin = 0;
+    uint32_t nbac = 0;
+    for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+      if (counts[i] > allocs.nbac_cap) {
+        LOG.error("universe {} has more bacteria than a batch can hold",
+          invoke.baseUniv + i);
+        return {};
+      }
+      if (i - begin == allocs.nuniv_cap ||
+        nbac + counts[i] > allocs.nbac_cap) {
+        rv.emplace_back(begin, i);
+        begin = i;
+        nbac = 0;
+      }
+      nbac += counts[i];
+    }
+    rv.emplace_back(begin, invoke.nSimUniv);
+    return rv;
+  }
+  // A part of an invocation that fits in the context, with the host data it
+  // refers to.
+  struct Chunk {
+    Invocation invoke;
+    std::vector<Bacterium> bacs;
+    std::vector<Bacterium> dirty_bacs;
+    DirtyRegions regions;
+    std::vector<float> biases;
+  };
+  // Bacteria in universes `[begin, end)` relative to `base_univ`.
+  std::vector<Bacterium> filter_bacs(const void* bacs, uint32_t nbac,
+    uint32_t base_univ, uint32_t begin, uint32_t end) {
+    std::vector<Bacterium> rv;
+    auto src = reinterpret_cast<const Bacterium*>(bacs);
+    for (auto i = 0u; i < nbac; ++i) {
+      if (src[i].univ >= base_univ + begin && src[i].univ < base_univ + end) {
+        rv.push_back(src[i]);
+      }
+    }
+    return rv;
+  }
+  Chunk make_chunk(const Cuvk& cuvk, const Invocation& invoke,
+    std::pair<uint32_t, uint32_t> range) {
+    auto [begin, end] = range;
+    Chunk rv { invoke, {}, {}, {}, {} };
+    auto& chunk_invoke = rv.invoke;
+    if (needs_chunking(cuvk, invoke)) {
+      rv.bacs = filter_bacs(invoke.pBacs, invoke.nBac, invoke.baseUniv,
+        begin, end);
+      chunk_invoke.pBacs = rv.bacs.data();
+      chunk_invoke.nBac = (uint32_t)rv.bacs.size();
+      if (is_incremental(invoke)) {
+        rv.dirty_bacs = filter_bacs(invoke.pDirtyBacs, invoke.nDirtyBac,
+          invoke.baseUniv, begin, end);
+        chunk_invoke.pDirtyBacs = rv.dirty_bacs.data();
+        chunk_invoke.nDirtyBac = (uint32_t)rv.dirty_bacs.size();
+      }
+      chunk_invoke.nSimUniv = end - begin;
+      chunk_invoke.baseUniv = invoke.baseUniv + begin;
+      chunk_invoke.pCosts = reinterpret_cast<float*>(invoke.pCosts) + begin;
+      if (invoke.pSimUnivs != nullptr) {
+        chunk_invoke.pSimUnivs = reinterpret_cast<uint8_t*>(invoke.pSimUnivs) +
+          begin * get_sim_univ_size(cuvk.mem_req);
+      }
+      if (is_multi_frame(invoke)) {
+        chunk_invoke.pRealUnivs = invoke.pRealUnivs + begin;
+      }
+      if (has_roi(invoke) && invoke.nRoi != 1) {
+        chunk_invoke.pRois = reinterpret_cast<const Rect*>(invoke.pRois) +
+          begin;
+        chunk_invoke.nRoi = end - begin;
+      }
+    }
+    rv.regions = make_dirty_regions(cuvk, chunk_invoke);
+    if (has_roi(chunk_invoke)) {
+      rv.biases = make_out_of_roi_sums(cuvk, chunk_invoke);
+    } else if (is_coverage(cuvk, chunk_invoke)) {
+      rv.biases = make_real_sums(cuvk, chunk_invoke);
+    }
+    return rv;
+  }
+  CuvkTaskStatus worker_main(Cuvk* cuvk, L_INOUT Task* task,
+    Invocation invoke) {
+    if (is_coarse_to_fine(*cuvk, invoke)) {
+      return coarse_to_fine_main(cuvk, task, invoke);
+    }
+    // Execute.
+    { // std::scoped_lock _(ctxt->submit_sync)
+      std::scoped_lock _(cuvk->submit_sync);
+
+      if (is_incremental(invoke) && !cuvk->has_base) {
+        LOG.error("incremental evaluation requires a base evaluation");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      if (cuvk->mem_req.useWeightMap && !cuvk->has_weight_map) {
+        LOG.error("weight map is not set");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      // Buffers are grown for the invocation before they are bound. The
+      // invocation is split into chunks of what they can hold, if they can't
+      // grow enough.
+      auto& limits = cuvk->ctxt.req.phys_dev_info->phys_dev_props.limits;
+      cuvk->grow_eval_bufs(
+        std::min(invoke.nBac, get_max_eval_nbac(limits, cuvk->mem_req)),
+        std::min(invoke.nSimUniv, cuvk->mem_req.nuniv));
+      auto ranges = split_chunks(*cuvk, invoke);
+      if (ranges.empty()) {
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      if (ranges.size() > 1) {
+        if (is_top_k(invoke)) {
+          LOG.error("unable to allocate evaluation buffers for top-K "
+            "selection, which can't be split");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        LOG.info("evaluation is split into {} chunks", ranges.size());
+      }
+      auto chunk = make_chunk(*cuvk, invoke, ranges[0]);
+      // The real universe sent along is shared by all chunks, so it's only
+      // uploaded with the first one.
+      auto real_univ = import_real_univ(*cuvk, invoke);
+      if (!upload(*task, chunk.invoke, 0,
+        is_real_univ_sent(invoke) ? &real_univ : nullptr)) {
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      for (auto i = 0u; i < ranges.size(); ++i) {
+        auto slot = i % NBAC_SLOT;
+        // The descriptor set and the command buffer are no longer in use as
+        // the previous chunk is done.
+        Buffers bufs(*cuvk, chunk.invoke, real_univ);
+        evaluation::write_desc_set(*task, chunk.invoke, bufs, slot);
+        if (!task->exec.make() ||
+          !evaluation::fill_cmd_buf(*task, chunk.invoke, bufs, chunk.regions,
+            slot) ||
+          !task->fence.make()) {
+          LOG.error("unable to fill command buffer for evaluation chunk");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        // Send input.
+        if (!input(*task, chunk.invoke, chunk.regions)) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        if (!send_univ_biases(chunk.invoke, bufs, cuvk->base_cost,
+          chunk.biases)) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        if (!task->exec.execute().submit(task->fence)) {
+          LOG.error("unable to submit command buffer");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        // Universes rendered by previous tasks are overwritten from now on.
+        ++cuvk->eval_gen;
+        // The next chunk is prepared on host, and its bacteria are uploaded to
+        // the other slot, while the device is working on this one.
+        Chunk next;
+        if (i + 1 < ranges.size()) {
+          next = make_chunk(*cuvk, invoke, ranges[i + 1]);
+          if (!upload(*task, next.invoke, (i + 1) % NBAC_SLOT, nullptr)) {
+            return CUVK_TASK_STATUS_ERROR;
+          }
+        }
+        // The outputs of this chunk have to be fetched before the next chunk
+        // reuses the buffers; the upload above is what overlaps with it.
+        if (task->fence.wait() == FenceStatus::Error) {
+          LOG.error("unable to wait the fence");
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        // Fetch output.
+        if (!output(*task, chunk.invoke, bufs)) {
+          return CUVK_TASK_STATUS_ERROR;
+        }
+        chunk = std::move(next);
+      }
+      // Only the universes of the last chunk are left on device, so they are
+      // not exposed for fetching if there are multiple chunks.
+      task->eval_gen = cuvk->eval_gen;
+      task->nsim_univ = ranges.size() == 1 ? invoke.nSimUniv : 0;
+    } // std::scoped_lock _(ctxt->submit_sync)
+    LOG.info("evaluation task is done");
+    return CUVK_TASK_STATUS_OK;
+  }
+  bool check_params(const Cuvk& cuvk, const Invocation& invoke) {
+    // FIXME: (penguinliong) This check is not comprehensive.
+    if (invoke.nBac == 0) {
+      LOG.warning("number of bacteria is 0; eval did nothing");
+    }
     if (invoke.nSimUniv == 0) {
       LOG.warning("number of simulated universes is 0; eval did nothing");
     }
     if (invoke.width == 0 || invoke.height == 0) {
       LOG.warning("the size of universes to be drawn is 0, eval did nothing");
     }
-    if (invoke.pSimUnivs == nullptr) {
-      LOG.error("`pSimUnivs` is `nullptr`");
+    if (invoke.pRealUniv == nullptr && invoke.realUniv == nullptr &&
+      invoke.pRealUnivs == nullptr) {
+      LOG.error("none of `pRealUniv`, `realUniv` and `pRealUnivs` is given");
+      return false;
+    }
+    if (invoke.pRealUnivs != nullptr) {
+      if (invoke.pDirtyBacs != nullptr) {
+        LOG.error("multi-frame evaluation can't be incremental");
+        return false;
+      }
+      for (auto i = 0u; i < invoke.nSimUniv; ++i) {
+        if (invoke.pRealUnivs[i] == nullptr) {
+          LOG.error("real universe of simulated universe {} is not given", i);
+          return false;
+        }
+      }
+    }
+    if (invoke.pRois != nullptr) {
+      if (invoke.pDirtyBacs != nullptr) {
+        LOG.error("evaluation with ROIs can't be incremental");
+        return false;
+      }
+      if (invoke.nRoi != 1 && invoke.nRoi != invoke.nSimUniv) {
+        LOG.error("number of ROIs must be either 1 or the number of simulated "
+          "universes");
+        return false;
+      }
+    }
+    if (is_top_k(invoke)) {
+      if (invoke.topK > invoke.nSimUniv) {
+        LOG.error("`topK` is greater than the number of simulated universes");
+        return false;
+      }
+      if (invoke.pTopUnivs == nullptr) {
+        LOG.error("`pTopUnivs` is required by top-K selection");
+        return false;
+      }
+      if (is_coarse_to_fine(cuvk, invoke)) {
+        LOG.error("top-K selection can't be used in coarse-to-fine evaluation");
+        return false;
+      }
+    }
+    if (exceeds_batch(cuvk, invoke) &&
+      (is_top_k(invoke) || is_coarse_to_fine(cuvk, invoke))) {
+      LOG.error("top-K selection and coarse-to-fine evaluation can't be used "
+        "when universes or bacteria exceed the context");
+      return false;
+    }
+    if (is_overlap_metric(cuvk.mem_req) &&
+      (invoke.pDirtyBacs != nullptr || invoke.pRois != nullptr ||
+      is_coarse_to_fine(cuvk, invoke))) {
+      LOG.error("IoU and Dice metrics can't be used in incremental, ROI or "
+        "coarse-to-fine evaluation");
       return false;
     }
-    if (invoke.pRealUniv == nullptr) {
-      LOG.error("`pRealUniv` is `nullptr`");
+    if (cuvk.mem_req.useWeightMap && invoke.pRois != nullptr) {
+      LOG.error("weight map can't be used in evaluation with ROIs");
       return false;
     }
+    if (is_coarse_to_fine(cuvk, invoke)) {
+      if (invoke.pDirtyBacs != nullptr || invoke.pRois != nullptr ||
+        invoke.pRealUnivs != nullptr) {
+        LOG.error("coarse-to-fine evaluation can't be incremental, or be used "
+          "with `pRois` or `pRealUnivs`");
+        return false;
+      }
+      if (invoke.pSimUnivs != nullptr) {
+        LOG.error("rendered universes can't be read back from coarse-to-fine "
+          "evaluation; `pSimUnivs` must be `nullptr`");
+        return false;
+      }
+    }
     if (invoke.pBacs == nullptr) {
       LOG.error("`pBacs` is `nullptr`");
       return false;
@@ -1098,6 +4060,9 @@ namespace evaluation {
       LOG.error("`pCosts` is `nullptr`");
       return false;
     }
+    if (invoke.pDirtyBacs == nullptr && invoke.nDirtyBac != 0) {
+      LOG.warning("`pDirtyBacs` is `nullptr`; evaluation is not incremental");
+    }
     return true;
   }
 }
@@ -1105,13 +4070,13 @@ CuvkResult L_STDCALL cuvkInvokeEvaluation(
   CuvkContext context,
   const CuvkEvaluationInvocation* pInvocation,
   L_OUT CuvkTask* pTask) {
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
   auto invoke = *pInvocation;
-  if (!evaluation::check_params(invoke)) {
+  if (!evaluation::check_params(*cuvk, invoke)) {
     return false;
   }
 
   // Create the task.
-  auto cuvk = reinterpret_cast<Cuvk*>(context);
   auto task = new Task(*cuvk, cuvk->pipes.cost_pipe.pipe_sec.desc_set_layout);
   if (!task->exec.make() || !task->desc_set.make()) {
     delete task;
@@ -1127,6 +4092,291 @@ CuvkResult L_STDCALL cuvkInvokeEvaluation(
 }
 
 
+
+namespace base_evaluation {
+  using Invocation = CuvkBaseEvaluationInvocation;
+
+  void write_desc_set(L_INOUT Task& task, const Invocation& invoke) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& sampler = task.cuvk.pipes.sampler;
+    // The base universe is costed as if it is the only simulated universe.
+    task.desc_set
+      .write(0, get_real_univ(task.cuvk, invoke.realUniv),
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(3, allocs.partial_costs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(4, allocs.base_univ, sampler,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+      .write(5, allocs.base_univ, sampler,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+      .write(6, allocs.dirty_rects, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(7, allocs.cover_mask, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(8, allocs.cover_costs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(9, allocs.dev_bacs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(10, allocs.sorted_bacs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(11, allocs.univ_counts, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(12, allocs.univ_offsets, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(13, allocs.draw_cmds, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(14, allocs.univ_frames, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(19, allocs.univ_running, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(20, allocs.partial_unions, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+      .write(21, allocs.weights, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  }
+  bool fill_cmd_buf(L_INOUT Task& task, const Invocation& invoke) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    auto& scheduling = task.cuvk.pipes.cost_pipe.scheduling;
+
+    struct {
+      uint32_t base_univ;
+      float ratio;
+    } eval_meta {
+      invoke.univ,
+      (float)invoke.width / (float)invoke.height,
+    };
+    std::array<uint32_t, 4> delta_meta {
+      scheduling.nsec_actual,
+      invoke.width,
+      0,
+      0,
+    };
+
+    auto rec = task.exec.record();
+    if (!rec.begin()) { return false; }
+    record_input_staging(rec, task.cuvk, 0, invoke.nBac,
+      invoke.realUniv == nullptr ? &allocs.real_univ : nullptr);
+    rec
+      // -----------------------------------------------------------------------
+      // Wait for inputs to be fully written.
+      .from_stage(VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT)
+        .barrier(allocs.dev_bacs,
+          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT)
+      .to_stage(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
+      .from_stage(VK_PIPELINE_STAGE_HOST_BIT)
+        .barrier(get_real_univ(task.cuvk, invoke.realUniv),
+          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(allocs.dirty_rects,
+          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+        .barrier(allocs.univ_frames,
+          VK_ACCESS_HOST_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      // -----------------------------------------------------------------------
+      // Previous base universe might still be sampled; discard it.
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.base_univ,
+          0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+      .to_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+      // -----------------------------------------------------------------------
+      // Draw the base universe.
+      .push_const(task.cuvk.pipes.eval_pipe.pipe,
+        VK_SHADER_STAGE_GEOMETRY_BIT,
+        0, sizeof(eval_meta), &eval_meta)
+      .draw(task.cuvk.pipes.eval_pipe.pipe, {},
+        allocs.dev_bacs.slice(0, invoke.nBac * sizeof(Bacterium)),
+        invoke.nBac, *allocs.base_univ_framebuf)
+      // -----------------------------------------------------------------------
+      // Wait for the base universe to be sampled.
+      .from_stage(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+        .barrier(allocs.base_univ,
+          VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+      .to_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+      // -----------------------------------------------------------------------
+      // Dispatch cost computation over the entire universe.
+      .push_const(task.cuvk.pipes.delta_pipe.pipe,
+        0, (uint32_t)delta_meta.size() * sizeof(uint32_t), delta_meta.data())
+      .dispatch(task.cuvk.pipes.delta_pipe.pipe, &task.desc_set,
+        1, scheduling.nsec_actual, 1)
+      // -----------------------------------------------------------------------
+      // Wait the cost to be computed and to be visible to host.
+      .from_stage(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+        .barrier(allocs.partial_costs,
+          VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+      .to_stage(VK_PIPELINE_STAGE_HOST_BIT);
+    return rec.end();
+  }
+  bool input(L_INOUT Task& task, const Invocation& invoke) {
+    auto& allocs = task.cuvk.allocs.evaluation_allocs;
+    if (!allocs.bacs.dev_mem_view().send(
+      invoke.pBacs, invoke.nBac * sizeof(Bacterium))) {
+      LOG.error("unable to send bacteria input");
+      return false;
+    }
+    if (invoke.realUniv == nullptr &&
+      !send_real_univ(task.cuvk, invoke.pRealUniv,
+        invoke.width, invoke.height)) {
+      LOG.error("unable to send real universe input");
+      return false;
+    }
+    Rect rect { 0, 0, invoke.width, invoke.height };
+    if (!allocs.dirty_rects.dev_mem_view().send(&rect, sizeof(Rect))) {
+      LOG.error("unable to send universe region");
+      return false;
+    }
+    uint32_t univ_frame = 0;
+    if (!allocs.univ_frames.dev_mem_view().send(
+      &univ_frame, sizeof(uint32_t))) {
+      LOG.error("unable to send real universe index");
+      return false;
+    }
+    return true;
+  }
+  CuvkTaskStatus worker_main(Cuvk* cuvk, L_INOUT Task* task,
+    Invocation invoke) {
+    if (!task->fence.make()) {
+      return CUVK_TASK_STATUS_ERROR;
+    }
+    // Execute.
+    { // std::scoped_lock _(ctxt->submit_sync)
+      std::scoped_lock _(cuvk->submit_sync);
+
+      if (cuvk->mem_req.useWeightMap && !cuvk->has_weight_map) {
+        LOG.error("weight map is not set");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      if (!cuvk->grow_eval_bufs(invoke.nBac, 1)) {
+        LOG.error("unable to allocate bacteria of the base universe");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      base_evaluation::write_desc_set(*task, invoke);
+      if (!base_evaluation::fill_cmd_buf(*task, invoke)) {
+        LOG.error("unable to fill command buffer for base evaluation task");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      // The resident base universe is about to be overwritten.
+      cuvk->has_base = false;
+      // Send input.
+      if (!input(*task, invoke)) {
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      if (!task->exec.execute().submit(task->fence)) {
+        LOG.error("unable to submit command buffer");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      if (task->fence.wait() == FenceStatus::Error) {
+        LOG.error("unable to wait the fence");
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      // Fetch output.
+      if (!sum_partial_costs(*task, 1,
+        cuvk->pipes.cost_pipe.scheduling.nsec_actual, 0., &cuvk->base_cost)) {
+        return CUVK_TASK_STATUS_ERROR;
+      }
+      cuvk->has_base = true;
+      if (invoke.pCost != nullptr) {
+        *reinterpret_cast<float*>(invoke.pCost) = cuvk->base_cost;
+      }
+    } // std::scoped_lock _(ctxt->submit_sync)
+    LOG.info("base evaluation task is done");
+    return CUVK_TASK_STATUS_OK;
+  }
+  bool check_params(const Cuvk& cuvk, const Invocation& invoke) {
+    if (is_overlap_metric(cuvk.mem_req)) {
+      LOG.error("base evaluation is not supported by IoU and Dice metrics");
+      return false;
+    }
+    if (invoke.width == 0 || invoke.height == 0) {
+      LOG.error("the size of the base universe is 0");
+      return false;
+    }
+    if (invoke.pBacs == nullptr && invoke.nBac != 0) {
+      LOG.error("`pBacs` is `nullptr`");
+      return false;
+    }
+    // The base universe is drawn in one batch.
+    auto& limits = cuvk.ctxt.req.phys_dev_info->phys_dev_props.limits;
+    if (invoke.nBac > get_max_eval_nbac(limits, cuvk.mem_req)) {
+      LOG.error("the base universe has more bacteria than a batch can hold");
+      return false;
+    }
+    if (invoke.pRealUniv == nullptr && invoke.realUniv == nullptr) {
+      LOG.error("neither `pRealUniv` nor `realUniv` is given");
+      return false;
+    }
+    return true;
+  }
+}
+CuvkResult L_STDCALL cuvkInvokeBaseEvaluation(
+  CuvkContext context,
+  const CuvkBaseEvaluationInvocation* pInvocation,
+  L_OUT CuvkTask* pTask) {
+  auto invoke = *pInvocation;
+  auto cuvk = reinterpret_cast<Cuvk*>(context);
+  if (!base_evaluation::check_params(*cuvk, invoke)) {
+    return false;
+  }
+
+  // Create the task.
+  auto task = new Task(*cuvk, cuvk->pipes.cost_pipe.pipe_sec.desc_set_layout);
+  if (!task->exec.make() || !task->desc_set.make()) {
+    delete task;
+    return false;
+  }
+
+  // Fill command buffer and execute asynchronously.
+  task->status = std::async(base_evaluation::worker_main, cuvk, task, invoke);
+  LOG.info("dispatched base evaluation task");
+  *pTask = reinterpret_cast<CuvkTask>(task);
+
+  return true;
+}
+
+
+CuvkResult L_STDCALL cuvkFetchUniverse(
+  CuvkTask task,
+  CuvkSize index,
+  L_OUT void* pDst) {
+  auto& task_ = *reinterpret_cast<Task*>(task);
+  auto& cuvk = task_.cuvk;
+  if (pDst == nullptr) {
+    LOG.error("`pDst` is `nullptr`");
+    return false;
+  }
+  if (task_.status.valid() &&
+    task_.status.wait_for(std::chrono::seconds(0)) !=
+    std::future_status::ready) {
+    LOG.error("the task is not finished yet");
+    return false;
+  }
+
+  std::scoped_lock _(cuvk.submit_sync);
+  if (task_.eval_gen == 0 || task_.eval_gen != cuvk.eval_gen) {
+    LOG.error("rendered universes of the task are not available; they might "
+      "have been overwritten by a later evaluation");
+    return false;
+  }
+  if (index >= task_.nsim_univ) {
+    LOG.error("universe index {} is out of range", index);
+    return false;
+  }
+  if (!task_.exec.make() || !universe_fetch::fill_cmd_buf(task_, { index })) {
+    LOG.error("unable to fill command buffer for universe fetch");
+    return false;
+  }
+  if (!task_.fence.make()) {
+    return false;
+  }
+  if (!task_.exec.execute().submit(task_.fence)) {
+    LOG.error("unable to submit command buffer");
+    return false;
+  }
+  if (task_.fence.wait() == FenceStatus::Error) {
+    LOG.error("unable to wait the fence");
+    return false;
+  }
+  auto univ_size = get_sim_univ_size(cuvk.mem_req);
+  auto& allocs = cuvk.allocs.evaluation_allocs;
+  if (!allocs.sim_univs.slice(index * univ_size, univ_size)
+    .dev_mem_view().fetch(pDst, univ_size)) {
+    LOG.error("unable to fetch the rendered universe");
+    return false;
+  }
+  return true;
+}
+
+
 CuvkTaskStatus L_STDCALL cuvkPoll(CuvkTask task) {
   auto& status = reinterpret_cast<Task*>(task)->status;
   try {
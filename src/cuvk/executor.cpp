@@ -131,11 +131,6 @@ bool Execution::submit(const Fence& fence) noexcept {
   si.signalSemaphoreCount = nsignal_sem;
   si.pSignalSemaphores = signal_sems.data();
 
-  if (L_VK <- vkQueueWaitIdle(exec->queue->queue)) {
-    LOG.error("unable to wait for queue to be idle");
-    return false;
-  }
-
   if (L_VK <- vkQueueSubmit(exec->queue->queue, 1, &si, fence.fence)) {
     LOG.error("unable to submit sommand buffer to queue");
     return false;
@@ -147,7 +142,7 @@ bool Execution::submit(const Fence& fence) noexcept {
 
 CommandRecorder::CommandRecorder(const Executable& exec) noexcept :
   exec(&exec),
-  cur((VkPipelineStageFlagBits)0),
+  cur(0),
   nimb(0),
   nbmb(0) {}
 bool CommandRecorder::begin() noexcept {
@@ -179,11 +174,11 @@ CommandRecorder::~CommandRecorder() noexcept {
 }
 
 CommandRecorder& CommandRecorder::from_stage(
-  VkPipelineStageFlagBits stage) noexcept {
+  VkPipelineStageFlags stages) noexcept {
   if (status != CommandRecorderStatus::OnAir) {
     LOG.warning("command buffer recording is not started");
   }
-  cur = stage;
+  cur = stages;
   status = CommandRecorderStatus::Barrier;
   return *this;
 }
@@ -226,18 +221,19 @@ CommandRecorder& CommandRecorder::barrier(const BufferSlice& buf_slice,
   return *this;
 }
 CommandRecorder& CommandRecorder::to_stage(
-  VkPipelineStageFlagBits stage) noexcept {
+  VkPipelineStageFlags stages) noexcept {
   if (status != CommandRecorderStatus::Barrier) {
     LOG.warning("barrier recording is not started");
   }
   if (nimb == 0 && nbmb == 0) {
+    status = CommandRecorderStatus::OnAir;
     return *this;
   }
   vkCmdPipelineBarrier(exec->cmd_buf,
-    cur, stage, 0,
+    cur, stages, 0,
     0, nullptr, nbmb, bmbs.data(), nimb, imbs.data());
   status = CommandRecorderStatus::OnAir;
-  cur = (VkPipelineStageFlagBits)0;
+  cur = 0;
   nimb = 0;
   nbmb = 0;
   return *this;
@@ -307,6 +303,28 @@ CommandRecorder& CommandRecorder::copy_img_to_buf(
     1, &bic);
   return *this;
 }
+CommandRecorder& CommandRecorder::copy_img_to_buf(
+  const ImageSlice& src, const BufferSlice& dst,
+  const VkRect2D& rect) noexcept {
+  if (status != CommandRecorderStatus::OnAir) {
+    LOG.warning("command buffer recording is not started");
+  }
+  VkBufferImageCopy bic {};
+  bic.bufferRowLength = src.img_alloc->req.extent.width;
+  bic.bufferImageHeight = src.img_alloc->req.extent.height;
+  bic.bufferOffset = dst.offset;
+  bic.imageOffset = { rect.offset.x, rect.offset.y, 0 };
+  bic.imageExtent = { rect.extent.width, rect.extent.height, 1 };
+  bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  bic.imageSubresource.baseArrayLayer = src.base_layer;
+  bic.imageSubresource.layerCount = src.nlayer.value_or(1);
+
+  vkCmdCopyImageToBuffer(exec->cmd_buf,
+    src.img_alloc->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    dst.buf_alloc->buf,
+    1, &bic);
+  return *this;
+}
 CommandRecorder& CommandRecorder::copy_img_to_img(
   const ImageSlice& src, const ImageSlice& dst) noexcept {
   if (status != CommandRecorderStatus::OnAir) {
@@ -328,6 +346,15 @@ CommandRecorder& CommandRecorder::copy_img_to_img(
     1, &ic);
   return *this;
 }
+CommandRecorder& CommandRecorder::fill_buf(
+  const BufferSlice& dst, uint32_t data) noexcept {
+  if (status != CommandRecorderStatus::OnAir) {
+    LOG.warning("command buffer recording is not started");
+  }
+  vkCmdFillBuffer(exec->cmd_buf,
+    dst.buf_alloc->buf, dst.offset, dst.size, data);
+  return *this;
+}
 
 CommandRecorder& CommandRecorder::push_const(
   const ComputePipeline& comp_pipe,
@@ -368,16 +395,16 @@ CommandRecorder& CommandRecorder::dispatch(
   vkCmdDispatch(exec->cmd_buf, x, y, z);
   return *this;
 }
-CommandRecorder& CommandRecorder::draw(
+// Begin the render pass of `framebuf` and bind everything needed for drawing.
+// The scissor covers the entire framebuffer if it's not given.
+void begin_draw(VkCommandBuffer cmd_buf,
   const GraphicsPipeline& graph_pipe,
   std::optional<const DescriptorSet*> desc_set,
-  const BufferSlice& vert_buf, uint32_t nvert,
-  const Framebuffer& framebuf) noexcept {
+  const BufferSlice& vert_buf,
+  const Framebuffer& framebuf,
+  std::optional<VkRect2D> scissor) noexcept {
   auto viewport = framebuf.req.extent;
 
-  if (status != CommandRecorderStatus::OnAir) {
-    LOG.warning("command buffer recording is not started");
-  }
   std::array<VkClearValue, 1> cv;
   cv[0].color = { { 0., 0., 0., 1. } };
 
@@ -389,7 +416,7 @@ CommandRecorder& CommandRecorder::draw(
   rpbi.clearValueCount = static_cast<uint32_t>(cv.size());
   rpbi.pClearValues = cv.data();
 
-  vkCmdBeginRenderPass(exec->cmd_buf, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
+  vkCmdBeginRenderPass(cmd_buf, &rpbi, VK_SUBPASS_CONTENTS_INLINE);
 
   VkViewport v {};
   v.width = (float)viewport.width;
@@ -397,28 +424,55 @@ CommandRecorder& CommandRecorder::draw(
   v.minDepth = 0.;
   v.maxDepth = 1.;
 
-  vkCmdSetViewport(exec->cmd_buf, 0, 1, &v);
+  vkCmdSetViewport(cmd_buf, 0, 1, &v);
 
-  VkRect2D scissor = {};
-  scissor.extent = viewport;
+  if (!scissor.has_value()) {
+    scissor = VkRect2D {};
+    scissor->extent = viewport;
+  }
 
-  vkCmdSetScissor(exec->cmd_buf, 0, 1, &scissor);
+  vkCmdSetScissor(cmd_buf, 0, 1, &*scissor);
 
   VkBuffer buf = vert_buf.buf_alloc->buf;
   VkDeviceSize offset = vert_buf.offset;
-  vkCmdBindVertexBuffers(exec->cmd_buf, 0, 1, &buf, &offset);
+  vkCmdBindVertexBuffers(cmd_buf, 0, 1, &buf, &offset);
 
-  vkCmdBindPipeline(exec->cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
+  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
     graph_pipe.pipe);
   if (desc_set.has_value()) {
-    vkCmdBindDescriptorSets(exec->cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
+    vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS,
       graph_pipe.pipe_layout, 0, 1, &(*desc_set)->desc_set, 0, nullptr);
   }
-  // TODO: (penguinliong) Push constants.
+}
+CommandRecorder& CommandRecorder::draw(
+  const GraphicsPipeline& graph_pipe,
+  std::optional<const DescriptorSet*> desc_set,
+  const BufferSlice& vert_buf, uint32_t nvert,
+  const Framebuffer& framebuf) noexcept {
+  if (status != CommandRecorderStatus::OnAir) {
+    LOG.warning("command buffer recording is not started");
+  }
+  begin_draw(exec->cmd_buf, graph_pipe, desc_set, vert_buf, framebuf,
+    std::nullopt);
   vkCmdDraw(exec->cmd_buf, nvert, 1, 0, 0);
   vkCmdEndRenderPass(exec->cmd_buf);
   return *this;
 }
+CommandRecorder& CommandRecorder::draw_indirect(
+  const GraphicsPipeline& graph_pipe,
+  std::optional<const DescriptorSet*> desc_set,
+  const BufferSlice& vert_buf, const BufferSlice& draw_cmd,
+  const Framebuffer& framebuf, std::optional<VkRect2D> scissor) noexcept {
+  if (status != CommandRecorderStatus::OnAir) {
+    LOG.warning("command buffer recording is not started");
+  }
+  begin_draw(exec->cmd_buf, graph_pipe, desc_set, vert_buf, framebuf,
+    scissor);
+  vkCmdDrawIndirect(exec->cmd_buf, draw_cmd.buf_alloc->buf, draw_cmd.offset,
+    1, sizeof(VkDrawIndirectCommand));
+  vkCmdEndRenderPass(exec->cmd_buf);
+  return *this;
+}
 
 
 
@@ -332,36 +332,39 @@ bool PipelineManager::make_comp_pipes() noexcept {
     }
 
     VkSpecializationInfo si {};
-    std::array<VkSpecializationMapEntry, 3> smes {};
+    std::vector<VkSpecializationMapEntry> smes {};
+    std::vector<uint32_t> spec_data {};
 
     VkComputePipelineCreateInfo cpci{};
     cpci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     cpci.layout = pipe.pipe_layout;
     cpci.stage = pipe.req.stages[0];
 
+    auto push_spec_const = [&](uint32_t id, uint32_t value) {
+      smes.push_back(VkSpecializationMapEntry {
+        id, (uint32_t)(spec_data.size() * sizeof(uint32_t)), sizeof(uint32_t)
+      });
+      spec_data.push_back(value);
+    };
     if (pipe.comp_req.local_workgrp.has_value()) {
-      smes[0].constantID = 1;
-      smes[0].size = sizeof(uint32_t);
-      smes[0].offset = 0;
-
-      smes[1].constantID = 2;
-      smes[1].size = sizeof(uint32_t);
-      smes[1].offset = sizeof(uint32_t);
-
-      smes[2].constantID = 3;
-      smes[2].size = sizeof(uint32_t);
-      smes[2].offset = 2 * sizeof(uint32_t);
-
-      si.mapEntryCount = static_cast<uint32_t>(smes.size());
-      si.pMapEntries = smes.data();
-      si.dataSize = sizeof(uint32_t) * pipe.comp_req.local_workgrp->size();
-      si.pData = pipe.comp_req.local_workgrp->data();
+      push_spec_const(1, pipe.comp_req.local_workgrp->at(0));
+      push_spec_const(2, pipe.comp_req.local_workgrp->at(1));
+      push_spec_const(3, pipe.comp_req.local_workgrp->at(2));
 
       LOG.info("compute pipeline '{}' has specialized its workgroups to "
         "({}, {}, {})", pipe.name,
         pipe.comp_req.local_workgrp->at(0),
         pipe.comp_req.local_workgrp->at(1),
         pipe.comp_req.local_workgrp->at(2));
+    }
+    for (auto& spec_const : pipe.comp_req.spec_consts) {
+      push_spec_const(spec_const.first, spec_const.second);
+    }
+    if (!smes.empty()) {
+      si.mapEntryCount = static_cast<uint32_t>(smes.size());
+      si.pMapEntries = smes.data();
+      si.dataSize = spec_data.size() * sizeof(uint32_t);
+      si.pData = spec_data.data();
       cpci.stage.pSpecializationInfo = &si;
     }
 
@@ -420,6 +423,43 @@ void PipelineManager::drop_comp_pipes() noexcept {
 
 
 
+Sampler::Sampler(const Context& ctxt) noexcept :
+  ctxt(&ctxt),
+  sampler(VK_NULL_HANDLE) {}
+bool Sampler::make() noexcept {
+  if (sampler) { return true; }
+
+  VkSamplerCreateInfo sci {};
+  sci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sci.magFilter = VK_FILTER_NEAREST;
+  sci.minFilter = VK_FILTER_NEAREST;
+  sci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sci.maxAnisotropy = 1.;
+  sci.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+
+  if (L_VK <- vkCreateSampler(ctxt->dev, &sci, nullptr, &sampler)) {
+    LOG.error("unable to create sampler");
+    return false;
+  }
+  return true;
+}
+void Sampler::drop() noexcept {
+  if (sampler) {
+    vkDestroySampler(ctxt->dev, sampler, nullptr);
+    sampler = VK_NULL_HANDLE;
+  }
+}
+Sampler::~Sampler() noexcept { drop(); }
+
+Sampler::Sampler(Sampler&& right) noexcept :
+  ctxt(right.ctxt),
+  sampler(std::exchange(right.sampler, nullptr)) {}
+
+
+
 DescriptorSet::DescriptorSet(
   const Context& ctxt,
   const DescriptorSetLayout& desc_set_layout) noexcept :
@@ -488,7 +528,24 @@ DescriptorSet& DescriptorSet::write(
   uint32_t bind_pt, const ImageView& img_view, VkImageLayout layout,
   VkDescriptorType desc_type) noexcept {
   VkDescriptorImageInfo dii {
-    VK_NULL_HANDLE, // TODO: (penguinliong) Use sampler.
+    VK_NULL_HANDLE,
+    img_view.img_view,
+    layout,
+  };
+  VkWriteDescriptorSet wds {
+    VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr,
+    desc_set, bind_pt, 0,
+    1, desc_type,
+    &dii, nullptr, nullptr,
+  };
+  vkUpdateDescriptorSets(ctxt->dev, 1, &wds, 0, nullptr);
+  return *this;
+}
+DescriptorSet& DescriptorSet::write(
+  uint32_t bind_pt, const ImageView& img_view, const Sampler& sampler,
+  VkImageLayout layout, VkDescriptorType desc_type) noexcept {
+  VkDescriptorImageInfo dii {
+    sampler.sampler,
     img_view.img_view,
     layout,
   };
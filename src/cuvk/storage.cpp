@@ -1,6 +1,7 @@
 #include "cuvk/storage.hpp"
 #include "cuvk/logger.hpp"
 #include "cuvk/context.hpp"
+#include "cuvk/transfer.hpp"
 #include <exception>
 
 L_CUVK_BEGIN_
@@ -50,6 +51,8 @@ const Span<VkMemoryPropertyFlags> get_mem_prop_fallback(MemoryVisibility vis) {
 
 inline uint32_t get_pixel_size(VkFormat fmt) noexcept {
   switch (fmt) {
+  case VK_FORMAT_R8_UNORM:
+    return sizeof(uint8_t);
   case VK_FORMAT_R32_SINT:
     return sizeof(int32_t);
   case VK_FORMAT_R32_UINT:
@@ -69,51 +72,79 @@ inline uint32_t get_pixel_size(VkFormat fmt) noexcept {
 
 
 
+// Get the host address of the slice, with no cache maintenance.
+void* get_mapped(const DeviceMemorySlice& slice, size_t size) noexcept {
+  if (size > slice.size) {
+    LOG.error("memory access out of range");
+    return nullptr;
+  }
+  if (slice.heap_alloc->mapped == nullptr) {
+    LOG.error("memory is not host-visible");
+    return nullptr;
+  }
+  return (char*)slice.heap_alloc->mapped + slice.offset;
+}
+// The range of the first `size` bytes of the slice, expanded to the atoms of
+// non-coherent memory.
+VkMappedMemoryRange make_mapped_rng(
+  const DeviceMemorySlice& slice, size_t size) noexcept {
+  auto atom_size = slice.heap_alloc->ctxt->req.phys_dev_info->phys_dev_props
+    .limits.nonCoherentAtomSize;
+  auto beg = slice.offset / atom_size * atom_size;
+  auto end = detail::align<VkDeviceSize>(slice.offset + size, atom_size);
+
+  VkMappedMemoryRange mmr {};
+  mmr.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  mmr.memory = slice.heap_alloc->dev_mem;
+  mmr.offset = beg;
+  // The block might not end at an atom boundary.
+  mmr.size = end < slice.heap_alloc->alloc_size ? end - beg : VK_WHOLE_SIZE;
+  return mmr;
+}
+
 bool DeviceMemorySlice::send(const void* data, size_t size) const noexcept {
-  auto dev_data = map(size);
+  auto dev_data = get_mapped(*this, size);
   if (dev_data == nullptr) { return false; }
-  // TODO: Use better memcpy.
-  std::memcpy(dev_data, data, size);
-  unmap();
-  return true;
+  TRANSFER.copy(dev_data, data, size, TransferDirection::ToDevice);
+  return flush(size);
 }
 bool DeviceMemorySlice::fetch(L_OUT void* data, size_t size) const noexcept {
-  auto dev_data = map(size);
-  if (dev_data == nullptr) { return false; }
-  // TODO: Use better memcpy.
-  std::memcpy(data, dev_data, size);
-  unmap();
+  auto dev_data = get_mapped(*this, size);
+  if (dev_data == nullptr || !invalidate(size)) { return false; }
+  TRANSFER.copy(data, dev_data, size, TransferDirection::FromDevice);
   return true;
 }
 bool DeviceMemorySlice::wipe() const noexcept {
-  auto dev_data = map(size);
+  auto dev_data = get_mapped(*this, size);
   if (dev_data == nullptr) { return false; }
   std::memset(dev_data, 0, size);
-  unmap();
-  return true;
+  return flush(size);
 }
 void* DeviceMemorySlice::map(size_t size) const noexcept {
-  if (size > this->size) {
-    LOG.error("memory write out of range");
-    return nullptr;
-  }
-  auto alignment = heap_alloc->ctxt->req.phys_dev_info->phys_dev_props
-    .limits.minMemoryMapAlignment;
-  auto map_offset = offset / alignment * alignment;
-  auto partial_offset = offset - map_offset;
-  auto map_size = detail::align(partial_offset + size, alignment);
-
-  void* dev_data;
-  if (L_VK <- vkMapMemory(
-    heap_alloc->ctxt->dev, heap_alloc->dev_mem,
-    map_offset, map_size, 0, &dev_data)) {
-    LOG.error("unable to map device data");
-    return nullptr;
-  }
-  return (char*)dev_data + partial_offset;
+  auto dev_data = get_mapped(*this, size);
+  if (dev_data == nullptr || !invalidate(size)) { return nullptr; }
+  return dev_data;
 }
 void DeviceMemorySlice::unmap() const noexcept {
-  vkUnmapMemory(heap_alloc->ctxt->dev, heap_alloc->dev_mem);
+  flush(size);
+}
+bool DeviceMemorySlice::flush(size_t size) const noexcept {
+  if (heap_alloc->is_coherent || size == 0) { return true; }
+  auto mmr = make_mapped_rng(*this, size);
+  if (L_VK <- vkFlushMappedMemoryRanges(heap_alloc->ctxt->dev, 1, &mmr)) {
+    LOG.error("unable to flush host writes to device memory");
+    return false;
+  }
+  return true;
+}
+bool DeviceMemorySlice::invalidate(size_t size) const noexcept {
+  if (heap_alloc->is_coherent || size == 0) { return true; }
+  auto mmr = make_mapped_rng(*this, size);
+  if (L_VK <- vkInvalidateMappedMemoryRanges(heap_alloc->ctxt->dev, 1, &mmr)) {
+    LOG.error("unable to invalidate host caches of device memory");
+    return false;
+  }
+  return true;
 }
 
 
@@ -309,11 +340,157 @@ ImageView ImageAllocation::view(
 
 
 
+HeapArena::HeapArena(const Context& ctxt, VkMemoryPropertyFlags mem_props,
+  uint32_t mem_type_idx) noexcept :
+  ctxt(&ctxt),
+  mem_props(mem_props),
+  mem_type_idx(mem_type_idx),
+  blocks(),
+  cur_block(nullptr),
+  cursor(0),
+  free_lists(),
+  used(0),
+  internal_frag(0),
+  free(0) {}
+HeapAllocation* HeapArena::alloc_block(VkDeviceSize size) noexcept {
+  VkMemoryAllocateInfo mai {};
+  mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mai.memoryTypeIndex = mem_type_idx;
+  // Ensure host-visible memories are aligned to be mappable.
+  if (mem_props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    auto& limits = ctxt->req.phys_dev_info->phys_dev_props.limits;
+    mai.allocationSize = detail::align<VkDeviceSize>(
+      size, limits.minMemoryMapAlignment);
+  } else {
+    mai.allocationSize = size;
+  }
+
+  VkDeviceMemory dev_mem;
+  if (L_VK <- vkAllocateMemory(ctxt->dev, &mai, nullptr, &dev_mem)) {
+    LOG.error("unable to allocate memory block of memory type {}",
+      mem_type_idx);
+    return nullptr;
+  }
+  // Host-visible blocks are mapped for their entire lifetime.
+  void* mapped = nullptr;
+  if (mem_props & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (L_VK <- vkMapMemory(ctxt->dev, dev_mem, 0, VK_WHOLE_SIZE, 0,
+      &mapped)) {
+      LOG.error("unable to map memory block of memory type {}", mem_type_idx);
+      vkFreeMemory(ctxt->dev, dev_mem, nullptr);
+      return nullptr;
+    }
+  }
+  return &blocks.emplace_back(HeapAllocation {
+    ctxt, mai.allocationSize, dev_mem, mapped,
+    (mem_props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0,
+  });
+}
+std::optional<ArenaRange> HeapArena::allocate(
+  VkDeviceSize size, VkDeviceSize alignment) noexcept {
+  uint32_t size_class = 0;
+  while (size_class < ARENA_NCLASS &&
+    (ARENA_MIN_CLASS_SIZE << size_class) < size) {
+    ++size_class;
+  }
+  if (size_class == ARENA_NCLASS) {
+    auto block = alloc_block(size);
+    if (block == nullptr) {
+      return std::nullopt;
+    }
+    used += size;
+    return ArenaRange { block, 0, size, DEDICATED };
+  }
+  auto class_size = ARENA_MIN_CLASS_SIZE << size_class;
+
+  // Reuse a freed range if there is any meeting the alignment.
+  auto& free_list = free_lists[size_class];
+  for (auto it = free_list.rbegin(); it != free_list.rend(); ++it) {
+    if (it->offset % alignment == 0) {
+      auto range = *it;
+      free_list.erase(std::next(it).base());
+      range.size = size;
+      free -= class_size;
+      used += size;
+      internal_frag += class_size - size;
+      return range;
+    }
+  }
+
+  // Bump a new range. The rest of the current block is abandoned if it's too
+  // small.
+  auto offset = detail::align(cursor, alignment);
+  if (cur_block == nullptr || offset + class_size > cur_block->alloc_size) {
+    auto block = alloc_block(ARENA_BLOCK_SIZE);
+    if (block == nullptr) {
+      return std::nullopt;
+    }
+    cur_block = block;
+    offset = 0;
+  }
+  cursor = offset + class_size;
+  used += size;
+  internal_frag += class_size - size;
+  return ArenaRange { cur_block, offset, size, size_class };
+}
+void HeapArena::free_range(const ArenaRange& range) noexcept {
+  used -= range.size;
+  if (range.size_class == DEDICATED) {
+    if (range.block->mapped != nullptr) {
+      vkUnmapMemory(ctxt->dev, range.block->dev_mem);
+    }
+    vkFreeMemory(ctxt->dev, range.block->dev_mem, nullptr);
+    blocks.remove_if([&](const HeapAllocation& block) {
+      return &block == range.block;
+    });
+    return;
+  }
+  auto class_size = ARENA_MIN_CLASS_SIZE << range.size_class;
+  internal_frag -= class_size - range.size;
+  free += class_size;
+  free_lists[range.size_class].push_back(range);
+}
+HeapStatistics HeapArena::statistics() const noexcept {
+  HeapStatistics rv {};
+  for (auto& block : blocks) {
+    ++rv.nblock;
+    rv.reserved += block.alloc_size;
+  }
+  rv.used = used;
+  rv.internal_frag = internal_frag;
+  rv.free = free;
+  rv.remaining = cur_block != nullptr ? cur_block->alloc_size - cursor : 0;
+  return rv;
+}
+void HeapArena::drop() noexcept {
+  for (auto& block : blocks) {
+    if (block.dev_mem != VK_NULL_HANDLE) {
+      if (block.mapped != nullptr) {
+        vkUnmapMemory(ctxt->dev, block.dev_mem);
+        block.mapped = nullptr;
+      }
+      vkFreeMemory(ctxt->dev, block.dev_mem, nullptr);
+      block.dev_mem = VK_NULL_HANDLE;
+    }
+  }
+  blocks.clear();
+  cur_block = nullptr;
+  cursor = 0;
+  for (auto& free_list : free_lists) {
+    free_list.clear();
+  }
+  used = 0;
+  internal_frag = 0;
+  free = 0;
+}
+
+
+
 HeapManager::HeapManager(const Context& ctxt) noexcept :
   ctxt(&ctxt),
   mem_types(), 
   mem_heaps(),
-  heap_allocs(),
+  arenas(),
   buf_allocs(),
   img_allocs() {}
 std::string translate_mem_props(VkMemoryPropertyFlags props) noexcept {
@@ -377,6 +554,9 @@ bool HeapManager::make() noexcept {
     LOG.error("unable to bind resources to memory");
     return false;
   }
+  auto stats = statistics();
+  LOG.info("reserved {} bytes in {} memory blocks", stats.reserved,
+    stats.nblock);
   return true;
 }
 void HeapManager::drop() noexcept {
@@ -391,11 +571,14 @@ void HeapManager::drop() noexcept {
     img_alloc.img = VK_NULL_HANDLE;
   }
   img_allocs.clear();
-  for (auto& heap_alloc : heap_allocs) {
-    vkFreeMemory(ctxt->dev, heap_alloc.second.dev_mem, nullptr);
-    heap_alloc.second.dev_mem = VK_NULL_HANDLE;
+  for (auto& block : imported_blocks) {
+    vkFreeMemory(ctxt->dev, block.dev_mem, nullptr);
+  }
+  imported_blocks.clear();
+  for (auto& arena : arenas) {
+    arena.second.drop();
   }
-  heap_allocs.clear();
+  arenas.clear();
 }
 HeapManager::~HeapManager() noexcept { drop(); }
 
@@ -428,6 +611,23 @@ std::pair<uint32_t, VkMemoryPropertyFlags> HeapManager::find_mem_type(
 uint32_t HeapManager::get_mem_heap_idx(uint32_t mem_type_idx) const noexcept {
   return mem_types[mem_type_idx].heapIndex;
 }
+HeapArena* HeapManager::find_arena(const VkMemoryRequirements& mem_req,
+  MemoryVisibility visibility) noexcept {
+  auto fallback = get_mem_prop_fallback(visibility);
+  auto pair = find_mem_type(mem_req.memoryTypeBits, fallback);
+  auto mem_type_idx = pair.first;
+  if (mem_type_idx == VK_MAX_MEMORY_TYPES) {
+    return nullptr;
+  }
+  LOG.info("matched memory type #{} ({})", mem_type_idx,
+    translate_mem_props(pair.second));
+  auto it = arenas.find(mem_type_idx);
+  if (it == arenas.end()) {
+    it = arenas.emplace_hint(it, mem_type_idx,
+      HeapArena(*ctxt, pair.second, mem_type_idx));
+  }
+  return &it->second;
+}
 
 
 
@@ -448,29 +648,22 @@ bool HeapManager::make_bufs() noexcept  {
     VkMemoryRequirements mem_req;
     vkGetBufferMemoryRequirements(ctxt->dev, buf, &mem_req);
 
-    auto fallback = get_mem_prop_fallback(buf_alloc.req.visibility);
-    auto pair = find_mem_type(mem_req.memoryTypeBits, fallback);
-    auto mem_type_idx = pair.first;
-    if (mem_type_idx == VK_MAX_MEMORY_TYPES) {
+    auto arena = find_arena(mem_req, buf_alloc.req.visibility);
+    if (arena == nullptr) {
       LOG.error("unable to find memory type for buffer #{}", i);
       return false;
-    } else {
-      LOG.info("matched memory type #{} ({}) for buffer #{}", mem_type_idx,
-        translate_mem_props(pair.second), i);
     }
-    auto mem_heap_idx = get_mem_heap_idx(mem_type_idx);
-
-    auto alloc = heap_allocs.find(mem_type_idx);
-    if (alloc == heap_allocs.end()) {
-      alloc = heap_allocs.emplace_hint(alloc,
-        mem_type_idx, HeapAllocation { ctxt });
+    // Resources declared before `make` are packed in the first block.
+    if (arena->blocks.empty()) {
+      arena->blocks.push_back(
+        HeapAllocation { ctxt, 0, VK_NULL_HANDLE, nullptr, true });
     }
-
-    auto& alloc_size = alloc->second.alloc_size;
-    auto offset_aligned = detail::align(alloc_size, mem_req.alignment);
+    auto& block = arena->blocks.front();
+    auto offset_aligned = detail::align(block.alloc_size, mem_req.alignment);
     buf_alloc.offset = offset_aligned;
-    buf_alloc.heap_alloc = &alloc->second;
-    alloc_size = offset_aligned + mem_req.size;
+    buf_alloc.heap_alloc = &block;
+    block.alloc_size = offset_aligned + mem_req.size;
+    arena->used += mem_req.size;
     ++i;
   }
   return true;
@@ -489,60 +682,42 @@ bool HeapManager::make_imgs() noexcept {
     VkMemoryRequirements mem_req;
     vkGetImageMemoryRequirements(ctxt->dev, img, &mem_req);
 
-    auto fallback = get_mem_prop_fallback(img_alloc.req.visibility);
-    auto pair = find_mem_type(mem_req.memoryTypeBits, fallback);
-    auto mem_type_idx = pair.first;
-    if (mem_type_idx == VK_MAX_MEMORY_TYPES) {
+    auto arena = find_arena(mem_req, img_alloc.req.visibility);
+    if (arena == nullptr) {
       LOG.error("unable to find memory type for image #{} (0 based)", i);
       return false;
-    } else {
-      LOG.info("matched memory type #{} ({}) for image #{}", mem_type_idx,
-        translate_mem_props(pair.second), i);
     }
-    auto mem_heap_idx = get_mem_heap_idx(mem_type_idx);
-
-    auto alloc = heap_allocs.find(mem_type_idx);
-    if (alloc == heap_allocs.end()) {
-      alloc = heap_allocs.emplace_hint(alloc,
-        mem_type_idx, HeapAllocation { ctxt });
+    if (arena->blocks.empty()) {
+      arena->blocks.push_back(
+        HeapAllocation { ctxt, 0, VK_NULL_HANDLE, nullptr, true });
     }
-
-    auto& alloc_size = alloc->second.alloc_size;
-    auto offset_aligned = detail::align(alloc_size, mem_req.alignment);
+    auto& block = arena->blocks.front();
+    auto offset_aligned = detail::align(block.alloc_size, mem_req.alignment);
     img_alloc.offset = offset_aligned;
-    img_alloc.heap_alloc = &alloc->second;
-    alloc_size = offset_aligned + mem_req.size;
+    img_alloc.heap_alloc = &block;
+    block.alloc_size = offset_aligned + mem_req.size;
+    arena->used += mem_req.size;
     ++i;
   }
   return true;
 }
 bool HeapManager::alloc_mem() noexcept {
-  // Allocate memory for each type.
-  for (auto& pair : heap_allocs) {
-    auto& heap_alloc = pair.second;
-    if (heap_alloc.alloc_size > 0) {
-      VkMemoryAllocateInfo mai {};
-      mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-      mai.memoryTypeIndex = pair.first;
-      // Ensure host-visible memories are aligned to be mappable.
-      if (mem_types[pair.first].propertyFlags &
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-        auto& limits = ctxt->req.phys_dev_info->phys_dev_props.limits;
-        mai.allocationSize = detail::align(
-          heap_alloc.alloc_size, limits.minMemoryMapAlignment);
-      } else {
-        mai.allocationSize = heap_alloc.alloc_size;
-      }
-
-      VkDeviceMemory dev_mem;
-      if (L_VK <- vkAllocateMemory(ctxt->dev, &mai, nullptr, &dev_mem)) {
+  // Allocate the first block for each type.
+  for (auto& pair : arenas) {
+    auto& arena = pair.second;
+    auto& block = arena.blocks.front();
+    if (block.alloc_size > 0) {
+      // The block is allocated to the end of the chain and moved to the front.
+      auto dev_block = arena.alloc_block(block.alloc_size);
+      if (dev_block == nullptr) {
         LOG.error("unable to allocate memory for resources requiring memory "
           "type {}", pair.first);
         return false;
       }
+      block = *dev_block;
+      arena.blocks.pop_back();
       LOG.info("allocated memory for resources requiring memory type {}",
         pair.first);
-      heap_alloc.dev_mem = dev_mem;
     }
   }
   return true;
@@ -587,6 +762,178 @@ const BufferAllocation& HeapManager::declare_buf(
     VK_NULL_HANDLE, nullptr, 0,
   });
 }
+const BufferAllocation* HeapManager::alloc_buf(
+  size_t size, VkBufferUsageFlags usage,
+  MemoryVisibility visibility) noexcept {
+  std::scoped_lock _(sync);
+  auto& buf_alloc = buf_allocs.emplace_back(BufferAllocation {
+    ctxt, { size, usage, visibility },
+    nullptr, VK_NULL_HANDLE, 0,
+  });
+  auto fail = [&]() -> const BufferAllocation* {
+    drop_buf(buf_alloc);
+    return nullptr;
+  };
+
+  buf_alloc.buf = create_buf(ctxt->dev, buf_alloc.req);
+  if (buf_alloc.buf == VK_NULL_HANDLE) {
+    return fail();
+  }
+  VkMemoryRequirements mem_req;
+  vkGetBufferMemoryRequirements(ctxt->dev, buf_alloc.buf, &mem_req);
+  auto arena = find_arena(mem_req, visibility);
+  if (arena == nullptr) {
+    LOG.error("unable to find memory type for buffer");
+    return fail();
+  }
+  buf_alloc.arena_range = arena->allocate(mem_req.size, mem_req.alignment);
+  if (!buf_alloc.arena_range) {
+    LOG.error("unable to sub-allocate memory for buffer");
+    return fail();
+  }
+  buf_alloc.heap_alloc = buf_alloc.arena_range->block;
+  buf_alloc.offset = buf_alloc.arena_range->offset;
+  if (L_VK <- vkBindBufferMemory(ctxt->dev, buf_alloc.buf,
+    buf_alloc.heap_alloc->dev_mem, buf_alloc.offset)) {
+    LOG.error("unable to bind buffer to its memory allocation");
+    return fail();
+  }
+  return &buf_alloc;
+}
+const BufferAllocation* HeapManager::import_buf(
+  void* host_ptr, size_t size, VkBufferUsageFlags usage) noexcept {
+  auto& phys_dev_info = *ctxt->req.phys_dev_info;
+  if (ctxt->get_mem_host_ptr_props == nullptr) {
+    return nullptr;
+  }
+  auto alignment = phys_dev_info.min_imported_host_ptr_align;
+  if (reinterpret_cast<uintptr_t>(host_ptr) % alignment != 0) {
+    return nullptr;
+  }
+  VkMemoryHostPointerPropertiesEXT mhpp {};
+  mhpp.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+  if (L_VK <- ctxt->get_mem_host_ptr_props(ctxt->dev,
+    VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, host_ptr,
+    &mhpp)) {
+    return nullptr;
+  }
+
+  std::scoped_lock _(sync);
+  auto& buf_alloc = buf_allocs.emplace_back(BufferAllocation {
+    ctxt, { detail::align<VkDeviceSize>(size, alignment), usage,
+      MemoryVisibility::HostVisible },
+    nullptr, VK_NULL_HANDLE, 0,
+  });
+  auto fail = [&]() -> const BufferAllocation* {
+    drop_buf(buf_alloc);
+    return nullptr;
+  };
+
+  VkExternalMemoryBufferCreateInfoKHR embci {};
+  embci.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO_KHR;
+  embci.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+  VkBufferCreateInfo bci {};
+  bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bci.pNext = &embci;
+  bci.size = buf_alloc.req.size;
+  bci.usage = usage;
+  if (L_VK <- vkCreateBuffer(ctxt->dev, &bci, nullptr, &buf_alloc.buf)) {
+    buf_alloc.buf = VK_NULL_HANDLE;
+    return fail();
+  }
+  VkMemoryRequirements mem_req;
+  vkGetBufferMemoryRequirements(ctxt->dev, buf_alloc.buf, &mem_req);
+  // Any memory type the host pointer can be imported as is fine.
+  auto mem_type_bits = mem_req.memoryTypeBits & mhpp.memoryTypeBits;
+  if (mem_type_bits == 0) {
+    return fail();
+  }
+  uint32_t mem_type_idx = 0;
+  while ((mem_type_bits & (1 << mem_type_idx)) == 0) {
+    ++mem_type_idx;
+  }
+  auto mem_props = mem_types[mem_type_idx].propertyFlags;
+
+  VkImportMemoryHostPointerInfoEXT imhpi {};
+  imhpi.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+  imhpi.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+  imhpi.pHostPointer = host_ptr;
+  VkMemoryAllocateInfo mai {};
+  mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mai.pNext = &imhpi;
+  mai.allocationSize = buf_alloc.req.size;
+  mai.memoryTypeIndex = mem_type_idx;
+  VkDeviceMemory dev_mem;
+  if (L_VK <- vkAllocateMemory(ctxt->dev, &mai, nullptr, &dev_mem)) {
+    return fail();
+  }
+  auto& block = imported_blocks.emplace_back(HeapAllocation {
+    ctxt, mai.allocationSize, dev_mem, host_ptr,
+    (mem_props & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0,
+  });
+  buf_alloc.heap_alloc = &block;
+  if (L_VK <- vkBindBufferMemory(ctxt->dev, buf_alloc.buf, dev_mem, 0)) {
+    return fail();
+  }
+  return &buf_alloc;
+}
+void HeapManager::free_buf(const BufferAllocation& buf_alloc) noexcept {
+  std::scoped_lock _(sync);
+  drop_buf(buf_alloc);
+}
+void HeapManager::drop_buf(const BufferAllocation& buf_alloc) noexcept {
+  if (buf_alloc.buf != VK_NULL_HANDLE) {
+    vkDestroyBuffer(ctxt->dev, buf_alloc.buf, nullptr);
+  }
+  // Imported memory is owned by the buffer.
+  imported_blocks.remove_if([&](const HeapAllocation& block) {
+    if (&block == buf_alloc.heap_alloc) {
+      vkFreeMemory(ctxt->dev, block.dev_mem, nullptr);
+      return true;
+    }
+    return false;
+  });
+  if (buf_alloc.arena_range) {
+    auto& range = *buf_alloc.arena_range;
+    for (auto& pair : arenas) {
+      for (auto& block : pair.second.blocks) {
+        if (&block == range.block) {
+          pair.second.free_range(range);
+          break;
+        }
+      }
+    }
+  }
+  buf_allocs.remove_if([&](const BufferAllocation& x) {
+    return &x == &buf_alloc;
+  });
+}
+void accumulate_stats(
+  HeapStatistics& rv, const HeapStatistics& stats) noexcept {
+  rv.nblock += stats.nblock;
+  rv.reserved += stats.reserved;
+  rv.used += stats.used;
+  rv.internal_frag += stats.internal_frag;
+  rv.free += stats.free;
+  rv.remaining += stats.remaining;
+}
+HeapStatistics HeapManager::statistics() const noexcept {
+  HeapStatistics rv {};
+  for (auto& pair : arenas) {
+    accumulate_stats(rv, pair.second.statistics());
+  }
+  return rv;
+}
+HeapStatistics HeapManager::statistics(
+  uint32_t mem_heap_idx) const noexcept {
+  HeapStatistics rv {};
+  for (auto& pair : arenas) {
+    if (get_mem_heap_idx(pair.first) == mem_heap_idx) {
+      accumulate_stats(rv, pair.second.statistics());
+    }
+  }
+  return rv;
+}
 const ImageAllocation& HeapManager::declare_img(
   const VkExtent2D& extent, std::optional<uint32_t> nlayer, VkFormat format,
   VkImageUsageFlags usage, VkImageTiling tiling,
@@ -0,0 +1,192 @@
+#include "cuvk/transfer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <system_error>
+#if defined(_M_X64) || defined(__x86_64__)
+#define L_CUVK_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+#endif
+
+L_CUVK_BEGIN_
+TransferEngine TRANSFER;
+
+#ifdef L_CUVK_X86
+// Non-temporal loads (`movntdqa`) are introduced in SSE4.1, which is not a part
+// of the x86-64 baseline, so they are compiled for it explicitly and only used
+// when the host supports it.
+#ifdef _MSC_VER
+#define L_TARGET_SSE41
+#else
+#define L_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif // _MSC_VER
+
+bool has_sse41() noexcept {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 19)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.1");
+#endif // _MSC_VER
+}
+const bool HAS_SSE41 = has_sse41();
+
+// Number of bytes from `ptr` to the next 16-byte boundary.
+size_t get_misalign(const void* ptr) noexcept {
+  return (16 - reinterpret_cast<uintptr_t>(ptr) % 16) % 16;
+}
+void stream_store(void* dst, const void* src, size_t size) noexcept {
+  auto head = std::min(get_misalign(dst), size);
+  std::memcpy(dst, src, head);
+  auto d = (char*)dst + head;
+  auto s = (const char*)src + head;
+  size -= head;
+  for (; size >= 64; size -= 64, d += 64, s += 64) {
+    auto x0 = _mm_loadu_si128((const __m128i*)s);
+    auto x1 = _mm_loadu_si128((const __m128i*)(s + 16));
+    auto x2 = _mm_loadu_si128((const __m128i*)(s + 32));
+    auto x3 = _mm_loadu_si128((const __m128i*)(s + 48));
+    _mm_stream_si128((__m128i*)d, x0);
+    _mm_stream_si128((__m128i*)(d + 16), x1);
+    _mm_stream_si128((__m128i*)(d + 32), x2);
+    _mm_stream_si128((__m128i*)(d + 48), x3);
+  }
+  std::memcpy(d, s, size);
+  // Non-temporal stores are weakly ordered. They must be done before the memory
+  // is flushed or the device is told to read it.
+  _mm_sfence();
+}
+L_TARGET_SSE41
+void stream_load(void* dst, const void* src, size_t size) noexcept {
+  auto head = std::min(get_misalign(src), size);
+  std::memcpy(dst, src, head);
+  auto d = (char*)dst + head;
+  auto s = (char*)src + head;
+  size -= head;
+  for (; size >= 64; size -= 64, d += 64, s += 64) {
+    auto x0 = _mm_stream_load_si128((__m128i*)s);
+    auto x1 = _mm_stream_load_si128((__m128i*)(s + 16));
+    auto x2 = _mm_stream_load_si128((__m128i*)(s + 32));
+    auto x3 = _mm_stream_load_si128((__m128i*)(s + 48));
+    _mm_storeu_si128((__m128i*)d, x0);
+    _mm_storeu_si128((__m128i*)(d + 16), x1);
+    _mm_storeu_si128((__m128i*)(d + 32), x2);
+    _mm_storeu_si128((__m128i*)(d + 48), x3);
+  }
+  std::memcpy(d, s, size);
+}
+#endif // L_CUVK_X86
+
+void transfer_chunk(L_OUT void* dst, const void* src, size_t size,
+  TransferDirection dir) noexcept {
+#ifdef L_CUVK_X86
+  if (size >= TRANSFER_STREAM_THRESHOLD) {
+    if (dir == TransferDirection::ToDevice) {
+      stream_store(dst, src, size);
+      return;
+    }
+    if (HAS_SSE41) {
+      stream_load(dst, src, size);
+      return;
+    }
+  }
+#endif // L_CUVK_X86
+  std::memcpy(dst, src, size);
+}
+
+
+
+void transfer_thread_main(TransferEngine& engine) noexcept {
+  for (;;) {
+    std::packaged_task<void()> job;
+    {
+      std::unique_lock<std::mutex> lk(engine.sync);
+      engine.cv.wait(lk, [&] { return engine.stop || !engine.jobs.empty(); });
+      // Remaining jobs are done before stopping, as callers are waiting for
+      // them.
+      if (engine.jobs.empty()) {
+        return;
+      }
+      job = std::move(engine.jobs.front());
+      engine.jobs.pop();
+    }
+    job();
+  }
+}
+
+TransferEngine::TransferEngine() noexcept :
+  workers(),
+  jobs(),
+  sync(),
+  cv(),
+  stop(false) {}
+bool TransferEngine::make() noexcept {
+  if (!workers.empty()) {
+    // Already started; keep it.
+    return true;
+  }
+  stop = false;
+  // The calling thread takes a share of each transfer, so one less worker is
+  // needed.
+  auto nthread = std::min(std::thread::hardware_concurrency(),
+    MAX_TRANSFER_THREAD_COUNT);
+  try {
+    for (uint32_t i = 1; i < nthread; ++i) {
+      workers.emplace_back([this] { transfer_thread_main(*this); });
+    }
+  } catch (const std::system_error&) {
+    drop();
+    return false;
+  }
+  return true;
+}
+void TransferEngine::drop() noexcept {
+  {
+    std::scoped_lock _(sync);
+    stop = true;
+  }
+  cv.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+TransferEngine::~TransferEngine() noexcept {
+  drop();
+}
+
+void TransferEngine::copy(L_OUT void* dst, const void* src, size_t size,
+  TransferDirection dir) noexcept {
+  size_t nthread = workers.size() + 1;
+  if (size < TRANSFER_PARALLEL_THRESHOLD || nthread == 1) {
+    transfer_chunk(dst, src, size, dir);
+    return;
+  }
+  // Chunks are rounded up to 64 bytes, the unit of the copy loops.
+  auto chunk_size = ((size + nthread - 1) / nthread + 63) / 64 * 64;
+  std::vector<std::future<void>> futs;
+  {
+    std::scoped_lock _(sync);
+    for (auto offset = chunk_size; offset < size; offset += chunk_size) {
+      auto chunk_dst = (char*)dst + offset;
+      auto chunk_src = (const char*)src + offset;
+      auto chunk_len = std::min(chunk_size, size - offset);
+      std::packaged_task<void()> job([=] {
+        transfer_chunk(chunk_dst, chunk_src, chunk_len, dir);
+      });
+      futs.emplace_back(job.get_future());
+      jobs.emplace(std::move(job));
+    }
+  }
+  cv.notify_all();
+  transfer_chunk(dst, src, std::min(chunk_size, size), dir);
+  for (auto& fut : futs) {
+    fut.wait();
+  }
+}
+
+L_CUVK_END_